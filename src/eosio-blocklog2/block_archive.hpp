@@ -0,0 +1,171 @@
+#pragma once
+
+#include <fc/io/json.hpp>
+#include <fc/reflect/reflect.hpp>
+
+#include <list>
+#include <memory>
+#include <mutex>
+
+#include "block_log_reader.hpp"
+
+namespace eosio {
+    namespace chain {
+
+       const char* const chunk_manifest_name = "manifest.json";
+
+       /// [first, last] cut into at most `parts` contiguous slices of (almost) equal size
+       inline vector<std::pair<uint32_t, uint32_t>> split_range( uint32_t first, uint32_t last, uint32_t parts ) {
+          vector<std::pair<uint32_t, uint32_t>> ranges;
+          if( first > last )
+             return ranges;
+          const uint64_t count = uint64_t(last) - first + 1;
+          parts = std::max<uint32_t>( 1, std::min<uint64_t>( parts, count ) );
+          for( uint32_t i = 0; i < parts; ++i )
+             ranges.emplace_back( first + count * i / parts, first + count * (i + 1) / parts - 1 );
+          return ranges;
+       }
+
+       /// one line of manifest.json in a chunk directory written by --export-chunks
+       struct chunk_manifest_entry {
+          string          directory;
+          uint32_t        first_block_num = 0;
+          uint32_t        last_block_num = 0;
+          block_id_type   previous;          ///< id of the block preceding first_block_num
+          block_id_type   first_block_id;
+          block_id_type   last_block_id;
+          uint64_t        log_size = 0;
+       };
+
+       /**
+        *  Source of blocks for the scan modes: either a plain blocks directory or a chunk directory,
+        *  i.e. a manifest.json next to one sub-directory per chunk, each a self-contained
+        *  blocks.log / blocks.index pair covering a contiguous block range.
+        *
+        *  Chunks are located from the manifest alone and opened on first use; at most `open_chunks` of them
+        *  stay open, least recently used first out, so archives of thousands of chunks stay within the fd limit.
+        *  A reader handed out remains valid for as long as the caller holds it, even once evicted.
+        */
+       struct block_archive {
+          using reader_ptr = std::shared_ptr<const block_log_reader>;
+
+          static bool is_chunk_dir( const boost::filesystem::path& dir ) {
+             return boost::filesystem::exists( dir / chunk_manifest_name );
+          }
+
+          explicit block_archive( const boost::filesystem::path& dir, size_t open_chunks = 64 )
+          :dir(dir), open_chunks(std::max<size_t>(1, open_chunks)) {
+             if( is_chunk_dir( dir ) ) {
+                manifest = fc::json::from_file( (dir / chunk_manifest_name).generic_string() ).as<vector<chunk_manifest_entry>>();
+                EOS_ASSERT( !manifest.empty(), block_log_exception, "Empty chunk manifest in ${d}", ("d", dir.generic_string()) );
+                for( size_t i = 0; i < manifest.size(); ++i ) {
+                   const auto& m = manifest[i];
+                   EOS_ASSERT( m.first_block_num <= m.last_block_num, block_log_exception, "Chunk ${c} has an empty range", ("c", m.directory) );
+                   EOS_ASSERT( i == 0 || m.first_block_num == manifest[i - 1].last_block_num + 1, block_log_exception,
+                               "Chunk ${c} does not continue the previous chunk", ("c", m.directory) );
+                }
+             } else {
+                single = std::make_shared<block_log_reader>( dir );
+             }
+          }
+
+          bool     chunked()const         { return !manifest.empty(); }
+          size_t   chunk_count()const     { return chunked() ? manifest.size() : 1; }
+          uint32_t first_block_num()const { return chunked() ? manifest.front().first_block_num : single->first_block_num(); }
+          uint32_t last_block_num()const  { return chunked() ? manifest.back().last_block_num : single->last_block_num(); }
+          bool     contains( uint32_t block_num )const { return block_num >= first_block_num() && block_num <= last_block_num(); }
+
+          reader_ptr reader_for( uint32_t block_num )const {
+             EOS_ASSERT( contains( block_num ), block_log_exception, "Block ${n} is not in block log", ("n", block_num) );
+             if( !chunked() )
+                return single;
+             auto itr = std::upper_bound( manifest.begin(), manifest.end(), block_num,
+                                          []( uint32_t n, const chunk_manifest_entry& m ) { return n < m.first_block_num; } );
+             return chunk_reader( itr - manifest.begin() - 1 );
+          }
+
+          /// reader of the i-th chunk, opened and checked against its manifest entry if it is not cached
+          reader_ptr chunk_reader( size_t i )const {
+             if( !chunked() )
+                return single;
+             std::lock_guard<std::mutex> lock( mtx );
+             auto itr = std::find_if( lru.begin(), lru.end(), [i]( const std::pair<size_t, reader_ptr>& c ) { return c.first == i; } );
+             if( itr != lru.end() ) {
+                if( itr != lru.begin() )
+                   lru.splice( lru.begin(), lru, itr );
+                return lru.front().second;
+             }
+             const auto& m = manifest[i];
+             auto r = std::make_shared<block_log_reader>( dir / m.directory );
+             EOS_ASSERT( r->first_block_num() == m.first_block_num && r->last_block_num() == m.last_block_num,
+                         block_log_exception, "Chunk ${c} does not match its manifest entry", ("c", m.directory) );
+             lru.emplace_front( i, r );
+             if( lru.size() > open_chunks )
+                lru.pop_back();
+             return r;
+          }
+
+          void read_block_bytes( uint32_t block_num, std::vector<char>& buf )const {
+             reader_for( block_num )->read_block_bytes( block_num, buf );
+          }
+
+          signed_block_ptr read_block_by_num( uint32_t block_num )const {
+             return reader_for( block_num )->read_block_by_num( block_num );
+          }
+
+          /**
+           *  Work units for [first, last]: the part of every chunk inside the range, so different chunks go to
+           *  different threads, or for a single log `parts` contiguous slices.
+           */
+          vector<std::pair<uint32_t, uint32_t>> split( uint32_t first, uint32_t last, uint32_t parts )const {
+             vector<std::pair<uint32_t, uint32_t>> ranges;
+             if( first > last )
+                return ranges;
+             if( chunked() ) {
+                for( const auto& m : manifest ) {
+                   const uint32_t f = std::max( first, m.first_block_num );
+                   const uint32_t l = std::min( last, m.last_block_num );
+                   if( f <= l )
+                      ranges.emplace_back( f, l );
+                }
+                return ranges;
+             }
+             return split_range( first, last, parts );
+          }
+
+          vector<chunk_manifest_entry>                 manifest;
+
+       private:
+          boost::filesystem::path                      dir;
+          size_t                                       open_chunks;
+          reader_ptr                                   single;
+          mutable std::mutex                           mtx;
+          mutable std::list<std::pair<size_t, reader_ptr>>  lru;   // most recently used first
+       };
+
+       /**
+        *  Per-thread decode target reused from block to block.  The read buffer and the signed_block with its
+        *  receipts vector, extensions and signature keep their storage, so a steady-state scan does not build and
+        *  free a new block graph for every block.  The returned reference is valid until the next decode().
+        */
+       struct block_decoder {
+          const signed_block& decode( const block_archive& archive, uint32_t block_num ) {
+             // scans stay inside one chunk for long runs, so the chunk cache is only consulted when leaving it
+             if( !reader || !reader->contains( block_num ) )
+                reader = archive.reader_for( block_num );
+             reader->read_block_bytes( block_num, buffer );
+             fc::datastream<const char*> ds( buffer.data(), buffer.size() );
+             block.new_producers.reset();   // fc leaves an absent optional untouched on unpack
+             fc::raw::unpack( ds, block );
+             return block;
+          }
+
+          std::vector<char>           buffer;
+          signed_block                block;
+          block_archive::reader_ptr   reader;
+       };
+
+    }
+} /// namespace eosio::chain
+
+FC_REFLECT(eosio::chain::chunk_manifest_entry, (directory)(first_block_num)(last_block_num)(previous)(first_block_id)(last_block_id)(log_size))
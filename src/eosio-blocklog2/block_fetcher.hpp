@@ -0,0 +1,216 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#ifdef EOSIO_TOOLS_IO_URING
+#include <liburing.h>
+#include <sys/uio.h>
+#endif
+
+#include "block_archive.hpp"
+
+namespace eosio {
+    namespace chain {
+
+       /**
+        *  Batch random-access block reader for index driven lookups.
+        *
+        *  Block offsets are resolved from blocks.index and the reads are kept in flight together: through
+        *  io_uring when the tool is built with liburing and the kernel supports it, otherwise on a pool of
+        *  threads doing pread(2).  Blocks are delivered either in completion order or in the order they were
+        *  requested; the callback is never invoked concurrently.
+        */
+       struct block_fetcher {
+          /// `packed_size` is the size of the block in the log, known from the index without packing it again
+          using callback = std::function<void( uint32_t block_num, const signed_block_ptr& block, uint64_t packed_size )>;
+
+          block_fetcher( const block_archive& archive, uint32_t queue_depth = 64, uint32_t threads = 16 )
+          :archive(archive), queue_depth(std::max(1u, queue_depth)), threads(std::max(1u, threads)) {}
+
+          void fetch( const vector<uint32_t>& block_nums, bool requested_order, const callback& cb ) {
+#ifdef EOSIO_TOOLS_IO_URING
+             if( fetch_uring( block_nums, requested_order, cb ) )
+                return;
+#endif
+             fetch_threads( block_nums, requested_order, cb );
+          }
+
+       private:
+          struct request {
+             uint32_t   block_num = 0;
+             int        fd = -1;
+             uint64_t   offset = 0;
+             uint64_t   size = 0;
+             block_archive::reader_ptr   reader;   // keeps fd open while the read is in flight
+          };
+
+          /// holds out of order completions until every earlier request has been delivered
+          struct reorder_buffer {
+             struct completed {
+                uint32_t           block_num = 0;
+                signed_block_ptr   block;
+                uint64_t           packed_size = 0;
+             };
+
+             void put( size_t index, uint32_t block_num, signed_block_ptr block, uint64_t packed_size, const callback& cb ) {
+                pending.emplace( index, completed{ block_num, std::move(block), packed_size } );
+                for( auto itr = pending.begin(); itr != pending.end() && itr->first == next; itr = pending.erase( itr ), ++next )
+                   cb( itr->second.block_num, itr->second.block, itr->second.packed_size );
+             }
+
+             size_t                                                     next = 0;
+             std::map<size_t, completed>                                pending;
+          };
+
+          request resolve( uint32_t block_num )const {
+             auto reader = archive.reader_for( block_num );
+             const auto extent = reader->get_block_extent( block_num );
+             return request{ block_num, reader->log_fd, extent.first, extent.second, reader };
+          }
+
+          /// how far requested order delivery may run ahead of the oldest undelivered block
+          size_t window()const { return size_t(queue_depth) * 4; }
+
+          void fetch_threads( const vector<uint32_t>& block_nums, bool requested_order, const callback& cb ) {
+             std::mutex              mtx;
+             std::condition_variable cv;
+             reorder_buffer          reorder;
+             std::atomic<size_t>     next_index{0};
+             std::atomic<bool>       failed{false};
+             std::exception_ptr      error;
+
+             const uint32_t n = std::max<size_t>( 1, std::min<size_t>( std::max( threads, queue_depth ), block_nums.size() ) );
+             vector<std::thread> workers;
+             for( uint32_t t = 0; t < n; ++t ) {
+                workers.emplace_back( [&]() {
+                   std::vector<char> buf;
+                   try {
+                      for( size_t i = next_index++; i < block_nums.size(); i = next_index++ ) {
+                         if( requested_order ) {
+                            std::unique_lock<std::mutex> lock( mtx );
+                            cv.wait( lock, [&]() { return failed || i < reorder.next + window(); } );
+                         }
+                         if( failed )
+                            break;
+                         const auto req = resolve( block_nums[i] );
+                         buf.resize( req.size );
+                         block_log_reader::read_exact( req.fd, buf.data(), buf.size(), req.offset );
+                         auto block = block_log_reader::unpack_block( buf.data(), buf.size() );
+
+                         std::lock_guard<std::mutex> lock( mtx );
+                         if( requested_order )
+                            reorder.put( i, req.block_num, std::move(block), req.size, cb );
+                         else
+                            cb( req.block_num, block, req.size );
+                         cv.notify_all();
+                      }
+                   } catch( ... ) {
+                      std::lock_guard<std::mutex> lock( mtx );
+                      if( !failed )
+                         error = std::current_exception();
+                      failed = true;
+                      cv.notify_all();
+                   }
+                });
+             }
+             for( auto& w : workers )
+                w.join();
+             if( error )
+                std::rethrow_exception( error );
+          }
+
+#ifdef EOSIO_TOOLS_IO_URING
+          struct uring_slot {
+             size_t              index = 0;
+             request             req;
+             std::vector<char>   buf;
+             uint64_t            done = 0;
+             iovec               iov;
+          };
+
+          struct uring_guard {
+             ~uring_guard() { if( ready ) io_uring_queue_exit( &ring ); }
+             io_uring    ring;
+             bool        ready = false;
+          };
+
+          /// returns false when io_uring is not available on this kernel so the caller can fall back
+          bool fetch_uring( const vector<uint32_t>& block_nums, bool requested_order, const callback& cb ) {
+             vector<uring_slot> slots( queue_depth );
+             uring_guard guard;      // declared after the buffers so the ring is torn down first
+             if( io_uring_queue_init( queue_depth, &guard.ring, 0 ) < 0 )
+                return false;
+             guard.ready = true;
+
+             vector<uring_slot*> free_slots;
+             for( auto& s : slots )
+                free_slots.push_back( &s );
+
+             auto queue_read = [&]( uring_slot* s ) {
+                auto* sqe = io_uring_get_sqe( &guard.ring );
+                s->iov.iov_base = s->buf.data() + s->done;
+                s->iov.iov_len  = s->req.size - s->done;
+                io_uring_prep_readv( sqe, s->req.fd, &s->iov, 1, s->req.offset + s->done );
+                io_uring_sqe_set_data( sqe, s );
+             };
+
+             reorder_buffer reorder;
+             size_t next_submit = 0;
+             size_t in_flight = 0;
+             while( next_submit < block_nums.size() || in_flight > 0 ) {
+                bool queued = false;
+                while( !free_slots.empty() && next_submit < block_nums.size() &&
+                       (!requested_order || next_submit < reorder.next + window()) ) {
+                   uring_slot* s = free_slots.back();
+                   free_slots.pop_back();
+                   s->index = next_submit;
+                   s->req   = resolve( block_nums[next_submit++] );
+                   s->buf.resize( s->req.size );
+                   s->done  = 0;
+                   queue_read( s );
+                   ++in_flight;
+                   queued = true;
+                }
+                if( queued )
+                   io_uring_submit( &guard.ring );
+
+                io_uring_cqe* cqe = nullptr;
+                const int rc = io_uring_wait_cqe( &guard.ring, &cqe );
+                EOS_ASSERT( rc == 0, block_log_exception, "io_uring wait failed: ${e}", ("e", strerror(-rc)) );
+                auto* s = static_cast<uring_slot*>( io_uring_cqe_get_data( cqe ) );
+                const int res = cqe->res;
+                io_uring_cqe_seen( &guard.ring, cqe );
+                EOS_ASSERT( res > 0, block_log_exception, "Reading block ${n} failed: ${e}",
+                            ("n", s->req.block_num)("e", res < 0 ? strerror(-res) : "unexpected end of file") );
+
+                s->done += res;
+                if( s->done < s->req.size ) {   // short read, queue the remainder
+                   queue_read( s );
+                   io_uring_submit( &guard.ring );
+                   continue;
+                }
+                --in_flight;
+                auto block = block_log_reader::unpack_block( s->buf.data(), s->buf.size() );
+                if( requested_order )
+                   reorder.put( s->index, s->req.block_num, std::move(block), s->req.size, cb );
+                else
+                   cb( s->req.block_num, block, s->req.size );
+                free_slots.push_back( s );
+             }
+             return true;
+          }
+#endif
+
+          const block_archive&   archive;
+          uint32_t               queue_depth;
+          uint32_t               threads;
+       };
+
+    }
+} /// namespace eosio::chain
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <eosio/chain/block.hpp>
+#include <eosio/chain/exceptions.hpp>
+#include <eosio/chain/config.hpp>
+
+#include <fc/io/raw.hpp>
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/path.hpp>
+
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace eosio {
+    namespace chain {
+
+       /**
+        *  Read-only view of blocks.log / blocks.index.
+        *
+        *  Unlike block_log it never opens the files for writing and never rebuilds the index, and every
+        *  read goes through pread(2), so one instance can be shared by any number of worker threads.
+        *
+        *  blocks.log layout: uint32 version, [uint32 first_block_num if version > 1], genesis, [totem],
+        *  then for each block the packed signed_block followed by the uint64 offset of that block.
+        *  blocks.index holds one uint64 offset per block, starting at first_block_num.
+        */
+       struct block_log_reader {
+          explicit block_log_reader( const boost::filesystem::path& blocks_dir ) {
+             auto block_file = blocks_dir / "blocks.log";
+             auto index_file = blocks_dir / "blocks.index";
+             log_fd = ::open( block_file.generic_string().c_str(), O_RDONLY );
+             EOS_ASSERT( log_fd >= 0, block_log_exception, "Unable to open ${f}", ("f", block_file.generic_string()) );
+             index_fd = ::open( index_file.generic_string().c_str(), O_RDONLY );
+             if( index_fd < 0 ) {
+                ::close( log_fd );
+                EOS_THROW( block_log_exception, "Unable to open ${f}", ("f", index_file.generic_string()) );
+             }
+
+             try {
+                struct stat st;
+                ::fstat( log_fd, &st );
+                log_size = st.st_size;
+                ::fstat( index_fd, &st );
+                index_size = st.st_size;
+                index_entries = index_size / sizeof(uint64_t);
+
+                uint32_t preamble[2] = {0, 1};
+                read_exact( log_fd, preamble, sizeof(preamble), 0 );
+                version = preamble[0];
+                first_num = version > 1 ? preamble[1] : 1;
+                EOS_ASSERT( index_entries > 0, block_log_exception, "No blocks found in ${f}", ("f", index_file.generic_string()) );
+             } catch( ... ) {
+                // the destructor does not run for a throwing constructor
+                ::close( log_fd );
+                ::close( index_fd );
+                throw;
+             }
+          }
+
+          ~block_log_reader() {
+             ::close( log_fd );
+             ::close( index_fd );
+          }
+
+          block_log_reader( const block_log_reader& ) = delete;
+          block_log_reader& operator=( const block_log_reader& ) = delete;
+
+          uint32_t first_block_num()const { return first_num; }
+          uint32_t last_block_num()const  { return first_num + index_entries - 1; }
+          bool     contains( uint32_t block_num )const { return block_num >= first_num && block_num <= last_block_num(); }
+
+          uint64_t get_block_pos( uint32_t block_num )const {
+             EOS_ASSERT( contains(block_num), block_log_exception, "Block ${n} is not in block log", ("n", block_num) );
+             uint64_t pos = 0;
+             read_exact( index_fd, &pos, sizeof(pos), uint64_t(block_num - first_num) * sizeof(uint64_t) );
+             return pos;
+          }
+
+          /// offset and packed size of a block; every entry is followed by its own uint64 offset
+          std::pair<uint64_t, uint64_t> get_block_extent( uint32_t block_num )const {
+             EOS_ASSERT( contains(block_num), block_log_exception, "Block ${n} is not in block log", ("n", block_num) );
+             uint64_t pos[2] = {0, 0};
+             if( block_num < last_block_num() ) {
+                read_exact( index_fd, pos, sizeof(pos), uint64_t(block_num - first_num) * sizeof(uint64_t) );
+             } else {
+                read_exact( index_fd, pos, sizeof(uint64_t), uint64_t(block_num - first_num) * sizeof(uint64_t) );
+                pos[1] = log_size;
+             }
+             EOS_ASSERT( pos[1] >= pos[0] + sizeof(uint64_t), block_log_exception,
+                         "Corrupted index entry for block ${n}", ("n", block_num) );
+             return std::make_pair( pos[0], pos[1] - pos[0] - sizeof(uint64_t) );
+          }
+
+          void read_block_bytes( uint32_t block_num, std::vector<char>& buf )const {
+             auto extent = get_block_extent( block_num );
+             buf.resize( extent.second );
+             read_exact( log_fd, buf.data(), buf.size(), extent.first );
+          }
+
+          signed_block_ptr read_block_by_num( uint32_t block_num )const {
+             std::vector<char> buf;
+             read_block_bytes( block_num, buf );
+             return unpack_block( buf.data(), buf.size() );
+          }
+
+          /// header only: reads the first few KB of the block instead of the whole block
+          signed_block_header read_block_header( uint32_t block_num )const {
+             const auto extent = get_block_extent( block_num );
+             std::vector<char> buf( std::min<uint64_t>( extent.second, 4096 ) );
+             read_exact( log_fd, buf.data(), buf.size(), extent.first );
+             signed_block_header header;
+             try {
+                fc::datastream<const char*> ds( buf.data(), buf.size() );
+                fc::raw::unpack( ds, header );
+             } catch( const fc::exception& ) {
+                // unusually large header (new producer schedule, extensions): fall back to the whole block
+                buf.resize( extent.second );
+                read_exact( log_fd, buf.data(), buf.size(), extent.first );
+                fc::datastream<const char*> ds( buf.data(), buf.size() );
+                fc::raw::unpack( ds, header );
+             }
+             return header;
+          }
+
+          /// the uint64 trailing the last block must point back at the last index entry
+          bool index_matches_log()const {
+             if( index_size % sizeof(uint64_t) != 0 || log_size < sizeof(uint64_t) )
+                return false;
+             uint64_t trailer = 0;
+             read_exact( log_fd, &trailer, sizeof(trailer), log_size - sizeof(uint64_t) );
+             return trailer == get_block_pos( last_block_num() );
+          }
+
+          /// everything in front of the first block: version, first_block_num, genesis and totem
+          std::vector<char> read_preamble()const {
+             std::vector<char> buf( get_block_pos( first_num ) );
+             read_exact( log_fd, buf.data(), buf.size(), 0 );
+             return buf;
+          }
+
+          static signed_block_ptr unpack_block( const char* data, size_t size ) {
+             auto b = std::make_shared<signed_block>();
+             fc::datastream<const char*> ds( data, size );
+             fc::raw::unpack( ds, *b );
+             return b;
+          }
+
+          static void read_exact( int fd, void* dst, size_t size, uint64_t offset ) {
+             char* p = static_cast<char*>(dst);
+             while( size > 0 ) {
+                auto r = ::pread( fd, p, size, offset );
+                if( r < 0 && errno == EINTR ) continue;
+                EOS_ASSERT( r > 0, block_log_exception, "Short read at offset ${o}", ("o", offset) );
+                p += r;
+                size -= r;
+                offset += r;
+             }
+          }
+
+          int        log_fd        = -1;
+          int        index_fd      = -1;
+          uint64_t   log_size      = 0;
+          uint64_t   index_size    = 0;
+          uint32_t   index_entries = 0;
+          uint32_t   version       = 0;
+          uint32_t   first_num     = 1;
+       };
+
+    }
+} /// namespace eosio::chain
@@ -16,20 +16,276 @@
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/path.hpp>
 
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unordered_set>
+
+#include "block_archive.hpp"
+#include "block_fetcher.hpp"
+#include "bounded_queue.hpp"
+#include "replay_file.hpp"
+#include "reversible_salvage.hpp"
+#include "sketches.hpp"
+#include "sqlite_writer.hpp"
+
 using namespace eosio::chain;
 namespace bfs = boost::filesystem;
 namespace bpo = boost::program_options;
 using bpo::options_description;
 using bpo::variables_map;
 
+/// per time window heavy hitter state; every member merges across threads and runs
+struct hitter_window {
+   hitter_window( uint32_t capacity = 1000 ) : actions(capacity), contracts(capacity) {}
+
+   void merge( const hitter_window& other ) {
+      blocks       += other.blocks;
+      transactions += other.transactions;
+      actions.merge( other.actions );
+      contracts.merge( other.contracts );
+      actors.merge( other.actors );
+   }
+
+   uint32_t       blocks = 0;
+   uint64_t       transactions = 0;
+   space_saving   actions;     ///< (contract, action)
+   space_saving   contracts;   ///< (contract, 0)
+   hyperloglog    actors;      ///< distinct authorizing accounts
+};
+
+FC_REFLECT(hitter_window, (blocks)(transactions)(actions)(contracts)(actors))
+
+/// window start (seconds since epoch) -> sketches
+using hitter_windows = std::map<uint32_t, hitter_window>;
+
+/// --sketch-out file: the sketches with the parameters they were built with, sketches only merge when these agree
+struct hitter_sketch_file {
+   uint64_t         magic = 0;
+   uint32_t         window_seconds = 0;
+   uint32_t         capacity = 0;
+   hitter_windows   windows;
+};
+
+FC_REFLECT(hitter_sketch_file, (magic)(window_seconds)(capacity)(windows))
+
+const uint64_t hitter_sketch_magic = 0x3148435453485248ull;   // "HRHSTCH1"
+
+void merge_hitter_windows( hitter_windows& into, const hitter_windows& from ) {
+   for( const auto& w : from ) {
+      auto itr = into.find( w.first );
+      if( itr == into.end() )
+         into.emplace( w.first, w.second );
+      else
+         itr->second.merge( w.second );
+   }
+}
+
+/// run work(thread_index, range_first, range_last) for every range; idle threads pick up the next pending range
+template<typename F>
+void run_parallel_ranges( const std::vector<std::pair<uint32_t, uint32_t>>& ranges, uint32_t threads, F&& work ) {
+   threads = std::max<uint32_t>( 1, std::min<size_t>( threads, ranges.size() ) );
+   std::atomic<size_t> next_range{0};
+   std::vector<std::thread> workers;
+   std::vector<std::exception_ptr> errors( threads );
+   for( uint32_t i = 0; i < threads; ++i ) {
+      workers.emplace_back( [&work, &errors, &ranges, &next_range, i]() {
+         try {
+            for( size_t r = next_range++; r < ranges.size(); r = next_range++ )
+               work( i, ranges[r].first, ranges[r].second );
+         } catch( ... ) {
+            errors[i] = std::current_exception();
+         }
+      });
+   }
+   for( auto& t : workers )
+      t.join();
+   for( auto& e : errors )
+      if( e ) std::rethrow_exception( e );
+}
+
+/**
+ * run_parallel_ranges() on threads started once and kept for every later call: for callers that hand over
+ * many small jobs, e.g. one per print batch, where starting and joining threads per job would dominate.
+ * The calling thread works on the job too, so `threads` - 1 are spawned.
+ */
+struct range_pool {
+   using ranges_type = std::vector<std::pair<uint32_t, uint32_t>>;
+
+   explicit range_pool( uint32_t threads ) {
+      for( uint32_t i = 1; i < threads; ++i )
+         workers.emplace_back( [this]() { worker_loop(); } );
+   }
+
+   ~range_pool() {
+      {
+         std::lock_guard<std::mutex> lock( mtx );
+         stopping = true;
+      }
+      job_cv.notify_all();
+      for( auto& t : workers )
+         t.join();
+   }
+
+   range_pool( const range_pool& ) = delete;
+   range_pool& operator=( const range_pool& ) = delete;
+
+   /// work(range_first, range_last) for every range; returns once all are done, rethrowing the first error
+   void run( const ranges_type& r, const std::function<void(uint32_t, uint32_t)>& work ) {
+      {
+         std::lock_guard<std::mutex> lock( mtx );
+         ranges = &r;
+         job = &work;
+         next_range = 0;
+         active = workers.size();
+         error = nullptr;
+         ++generation;
+      }
+      job_cv.notify_all();
+      drain();
+      std::unique_lock<std::mutex> lock( mtx );
+      done_cv.wait( lock, [this]() { return active == 0; } );
+      ranges = nullptr;
+      job = nullptr;
+      if( error )
+         std::rethrow_exception( error );
+   }
+
+private:
+   void drain() {
+      try {
+         for( size_t i = next_range++; i < ranges->size(); i = next_range++ )
+            (*job)( (*ranges)[i].first, (*ranges)[i].second );
+      } catch( ... ) {
+         std::lock_guard<std::mutex> lock( mtx );
+         if( !error )
+            error = std::current_exception();
+         next_range = ranges->size();
+      }
+   }
+
+   void worker_loop() {
+      uint64_t seen = 0;
+      for( ;; ) {
+         {
+            std::unique_lock<std::mutex> lock( mtx );
+            job_cv.wait( lock, [&]() { return stopping || generation != seen; } );
+            if( stopping )
+               return;
+            seen = generation;
+         }
+         drain();
+         {
+            std::lock_guard<std::mutex> lock( mtx );
+            --active;
+         }
+         done_cv.notify_all();
+      }
+   }
+
+   std::vector<std::thread>                                workers;
+   std::mutex                                              mtx;
+   std::condition_variable                                 job_cv;
+   std::condition_variable                                 done_cv;
+   const ranges_type*                                      ranges = nullptr;
+   const std::function<void(uint32_t, uint32_t)>*          job = nullptr;
+   std::atomic<size_t>                                     next_range{0};
+   size_t                                                  active = 0;
+   uint64_t                                                generation = 0;
+   bool                                                    stopping = false;
+   std::exception_ptr                                      error;
+};
+
+/// a packed transaction decompressed and hashed once, shared by every output section that needs it
+struct unpacked_trx {
+   transaction           trx;
+   transaction_id_type   id;
+};
+
+/// blocks printed per batch; the transactions of a batch are unpacked in parallel before printing
+const size_t print_batch_size = 256;
+
+/**
+ * The block as abi_serializer::to_variant renders it without ABIs, but built from the already unpacked
+ * transactions instead of decompressing and hashing every packed_transaction again.
+ */
+fc::variant block_to_variant( const signed_block& block, const std::vector<unpacked_trx>& unpacked ) {
+   fc::variants receipts;
+   receipts.reserve( block.transactions.size() );
+   for( size_t i = 0; i < block.transactions.size(); ++i ) {
+      const auto& receipt = block.transactions[i];
+      fc::variant trx;
+      if( receipt.trx.contains<packed_transaction>() ) {
+         const auto& ptrx = receipt.trx.get<packed_transaction>();
+         const fc::variant packed( ptrx );
+         const auto& fields = packed.get_object();
+         trx = fc::mutable_variant_object
+               ("id", unpacked[i].id)
+               ("signatures", fields["signatures"])
+               ("compression", fields["compression"])
+               ("packed_context_free_data", fields["packed_context_free_data"])
+               ("context_free_data", ptrx.get_context_free_data())
+               ("packed_trx", fields["packed_trx"])
+               ("transaction", unpacked[i].trx);
+      } else {
+         trx = fc::variant( receipt.trx.get<transaction_id_type>() );
+      }
+      receipts.emplace_back( fc::mutable_variant_object
+            ("status", receipt.status)
+            ("cpu_usage_us", receipt.cpu_usage_us)
+            ("net_usage_words", receipt.net_usage_words)
+            ("trx", std::move(trx)) );
+   }
+   const fc::variant header( static_cast<const signed_block_header&>(block) );
+   return fc::mutable_variant_object( header.get_object() )
+         ("transactions", std::move(receipts))
+         ("block_extensions", block.block_extensions);
+}
+
+/// streaming mean / variance (Welford)
+struct sample_stat {
+   void add( double x ) {
+      ++n;
+      const double d = x - mean;
+      mean += d / n;
+      m2 += d * (x - mean);
+   }
+
+   double variance()const { return n > 1 ? m2 / (n - 1) : 0; }
+
+   uint64_t  n = 0;
+   double    mean = 0;
+   double    m2 = 0;
+};
+
 struct blocklog {
    blocklog()
    {}
 
    void read_log();
+   void print_info();
+   void report_heavy_hitters();
+   void report_sample();
+   void load_sqlite();
+   void export_chunks();
+   void verify_chunks();
+   void merge_reversible();
+   void write_replay();
+   void read_replay();
    void set_program_options(options_description& cli);
    void initialize(const variables_map& options);
 
+   std::ostream* open_output(std::ofstream& output_blocks);
+   std::vector<std::vector<unpacked_trx>> unpack_transactions(const std::vector<signed_block_ptr>& blocks);
+   void scan_heavy_hitters(const block_archive& reader, uint32_t first, uint32_t last, hitter_windows& windows);
+   void build_sql_rows(const block_archive& reader, block_decoder& decoder, uint32_t block_num, sql_batch& batch);
+   chunk_manifest_entry write_chunk(const block_archive& source, uint32_t first, uint32_t last);
+
    bfs::path                        blocks_dir;
    bfs::path                        output_file;
    uint32_t                         first_block;
@@ -44,6 +300,39 @@ struct blocklog {
    uint32_t                         pack_headers_from;
    uint32_t                         pack_headers_interval;
    uint32_t                         pack_headers_times;
+
+   bool                             heavy_hitters;
+   uint32_t                         hitters_window;
+   uint32_t                         hitters_top;
+   uint32_t                         hitters_capacity;
+   std::vector<bfs::path>           sketch_in;
+   bfs::path                        sketch_out;
+   uint32_t                         threads;
+
+   bfs::path                        sqlite_db;
+   uint32_t                         sqlite_batch;
+
+   uint32_t                         export_chunk_size;
+   bfs::path                        chunks_dir;
+   bool                             verify_chunks_only;
+
+   bfs::path                        block_list;
+   bool                             completion_order;
+   uint32_t                         io_depth;
+
+   uint32_t                         sample_size;
+   uint32_t                         sample_every;
+   uint64_t                         sample_seed;
+
+   bool                             salvage_reversible;
+   bfs::path                        merge_reversible_dir;
+
+   bfs::path                        replay_out;
+   std::vector<string>              replay_accounts;
+   bfs::path                        replay_in;
+   double                           replay_speed;
+
+   std::unique_ptr<range_pool>      unpack_pool;   ///< started by the first unpack_transactions()
 };
 
 template <typename T>
@@ -68,62 +357,78 @@ struct transaction_receipt_type : public transaction_receipt_header {
 FC_REFLECT_DERIVED(transaction_receipt_type, (eosio::chain::transaction_receipt_header), (trx) )
 
 void blocklog::read_log() {
-   block_log block_logger(blocks_dir);
-   const auto end = block_logger.read_head();
-   EOS_ASSERT( end, block_log_exception, "No blocks found in block log" );
-   EOS_ASSERT( end->block_num() > 1, block_log_exception, "Only one block found in block log" );
-
-   std::cout << "block.log and block.index contains block(s): [ 1 - " << end->block_num() << " ]" << std::endl;
+   if( info ) {
+      print_info();
+      return;
+   }
 
+   optional<block_log> block_logger;
+   optional<block_archive> chunks;
+   std::function<signed_block_ptr(uint32_t)> read_block_by_num;
    optional<chainbase::database> reversible_blocks;
-   try {
-      reversible_blocks.emplace(blocks_dir / config::reversible_blocks_dir_name, chainbase::database::read_only, config::default_reversible_cache_size);
-      reversible_blocks->add_index<reversible_block_index>();
-      const auto& idx = reversible_blocks->get_index<reversible_block_index,by_num>();
-      auto first = idx.lower_bound(end->block_num());
-      auto last = idx.rbegin();
-      if (first != idx.end() && last != idx.rend())
-         std::cout << "existing reversible block num: [ " << first->get_block()->block_num() << " - " << last->get_block()->block_num() << " ]" << std::endl;
-      else {
-         elog( "no blocks available in reversible block database: only block_log blocks are available" );
-         reversible_blocks.reset();
-      }
-   } catch( const std::runtime_error& e ) {
-      if( std::string(e.what()) == "database dirty flag set" ) {
-         elog( "database dirty flag set (likely due to unclean shutdown): only block_log blocks are available" );
-      } else if( std::string(e.what()) == "database metadata dirty flag set" ) {
-         elog( "database metadata dirty flag set (likely due to unclean shutdown): only block_log blocks are available" );
+   vector<salvaged_block> salvaged;
+
+   if( block_archive::is_chunk_dir( blocks_dir ) ) {
+      chunks.emplace( blocks_dir );
+      read_block_by_num = [&]( uint32_t n ) {
+         return chunks->contains( n ) ? chunks->read_block_by_num( n ) : signed_block_ptr();
+      };
+      std::cout << "chunk directory contains block(s): [ " << chunks->first_block_num() << " - " << chunks->last_block_num()
+                << " ] in " << chunks->chunk_count() << " chunk(s)" << std::endl;
+   } else {
+      block_logger.emplace(blocks_dir);
+      read_block_by_num = [&]( uint32_t n ) { return block_logger->read_block_by_num( n ); };
+      const auto end = block_logger->read_head();
+      EOS_ASSERT( end, block_log_exception, "No blocks found in block log" );
+      EOS_ASSERT( end->block_num() > 1, block_log_exception, "Only one block found in block log" );
+
+      std::cout << "block.log and block.index contains block(s): [ 1 - " << end->block_num() << " ]" << std::endl;
+
+      if( salvage_reversible ) {
+         auto salvage = salvage_reversible_blocks( blocks_dir / config::reversible_blocks_dir_name, end->block_num(), end->id() );
+         if( !salvage.blocks.empty() )
+            std::cout << "salvaged reversible block num: [ " << salvage.blocks.front().block->block_num() << " - "
+                      << salvage.blocks.back().block->block_num() << " ]" << std::endl;
+         else
+            elog( "no reversible blocks salvaged: only block_log blocks are available" );
+         std::cout << "reversible index entries visited: " << salvage.entries << ", at or below log head: " << salvage.skipped << std::endl;
+         if( !salvage.stop_reason.empty() )
+            wlog( "reversible salvage stopped: ${r}", ("r", salvage.stop_reason) );
+         salvaged = std::move( salvage.blocks );
       } else {
-         throw;
+         try {
+            reversible_blocks.emplace(blocks_dir / config::reversible_blocks_dir_name, chainbase::database::read_only, config::default_reversible_cache_size);
+            reversible_blocks->add_index<reversible_block_index>();
+            const auto& idx = reversible_blocks->get_index<reversible_block_index,by_num>();
+            auto first = idx.lower_bound(end->block_num());
+            auto last = idx.rbegin();
+            if (first != idx.end() && last != idx.rend())
+               std::cout << "existing reversible block num: [ " << first->get_block()->block_num() << " - " << last->get_block()->block_num() << " ]" << std::endl;
+            else {
+               elog( "no blocks available in reversible block database: only block_log blocks are available" );
+               reversible_blocks.reset();
+            }
+         } catch( const std::runtime_error& e ) {
+            if( std::string(e.what()) == "database dirty flag set" ) {
+               elog( "database dirty flag set (likely due to unclean shutdown): only block_log blocks are available, try --salvage-reversible" );
+            } else if( std::string(e.what()) == "database metadata dirty flag set" ) {
+               elog( "database metadata dirty flag set (likely due to unclean shutdown): only block_log blocks are available, try --salvage-reversible" );
+            } else {
+               throw;
+            }
+         }
       }
    }
-   if(info) return;
 
    std::ofstream output_blocks;
-   std::ostream* out;
-   if (!output_file.empty()) {
-      output_blocks.open(output_file.generic_string().c_str());
-      if (output_blocks.fail()) {
-         std::ostringstream ss;
-         ss << "Unable to open file '" << output_file.string() << "'";
-         throw std::runtime_error(ss.str());
-      }
-      out = &output_blocks;
-   }
-   else
-      out = &std::cout;
+   std::ostream* out = open_output(output_blocks);
 
    if (as_json_array)
       *out << "[";
-   uint32_t block_num = (first_block < 1) ? 1 : first_block;
+   uint32_t block_num = std::max( first_block, chunks ? chunks->first_block_num() : 1u );
    signed_block_ptr next;
-   fc::variant pretty_output;
-   const fc::microseconds deadline = fc::seconds(10);
-   auto print_block = [&](signed_block_ptr& next) {
-      abi_serializer::to_variant(*next,
-                                 pretty_output,
-                                 []( account_name n ) { return optional<abi_serializer>(); },
-                                 deadline);
+   auto print_block = [&](const signed_block_ptr& next, const std::vector<unpacked_trx>& unpacked) {
+      const fc::variant pretty_output = block_to_variant(*next, unpacked);
       const auto block_id = next->id();
       const uint32_t ref_block_prefix = block_id._hash[1];
       const auto enhanced_object = fc::mutable_variant_object
@@ -144,7 +449,10 @@ void blocklog::read_log() {
       }
 
       if( print_packed_trx ){
-         for( auto const & trx : next->transactions ){
+         for( size_t i = 0; i < next->transactions.size(); ++i ){
+            const auto& trx = next->transactions[i];
+            if( !trx.trx.contains<packed_transaction>() )
+               continue;
             transaction_receipt_type tx;
             tx.net_usage_words = trx.net_usage_words;
             tx.cpu_usage_us = trx.cpu_usage_us;
@@ -152,35 +460,67 @@ void blocklog::read_log() {
             tx.trx = trx.trx.get<packed_transaction>();
 
             bytes s = fc::raw::pack( tx );
-            print_hex( out, string("packed_trx_") + trx.trx.get<packed_transaction>().id().str(), s.data(), s.size());
+            print_hex( out, string("packed_trx_") + unpacked[i].id.str(), s.data(), s.size());
          }
       }
    };
 
-   if( pack_headers_from == 0 ){
-      bool contains_obj = false;
-      while((block_num <= last_block) && (next = block_logger.read_block_by_num( block_num ))) {
+   bool contains_obj = false;
+   std::vector<signed_block_ptr> pending;
+   auto flush_blocks = [&]() {
+      const auto unpacked = unpack_transactions( pending );
+      for( size_t i = 0; i < pending.size(); ++i ) {
          if (as_json_array && contains_obj)
             *out << ",";
-         print_block(next);
-         ++block_num;
+         print_block( pending[i], unpacked[i] );
          contains_obj = true;
       }
+      pending.clear();
+   };
+   auto queue_block = [&](const signed_block_ptr& block) {
+      pending.push_back( block );
+      if( pending.size() >= print_batch_size )
+         flush_blocks();
+   };
+
+   if( !block_list.empty() ){
+      std::vector<uint32_t> block_nums;
+      std::ifstream list( block_list.generic_string().c_str() );
+      EOS_ASSERT( list.good(), block_log_exception, "Unable to open file '${f}'", ("f", block_list.generic_string()) );
+      for( uint32_t n; list >> n; )
+         block_nums.push_back( n );
+
+      block_archive archive( blocks_dir );
+      block_fetcher fetcher( archive, io_depth, threads );
+      fetcher.fetch( block_nums, !completion_order, [&]( uint32_t, const signed_block_ptr& block, uint64_t ) {
+         queue_block( block );
+      });
+      flush_blocks();
+   } else if( pack_headers_from == 0 ){
+      while((block_num <= last_block) && (next = read_block_by_num( block_num ))) {
+         queue_block(next);
+         ++block_num;
+      }
       if ( reversible_blocks ) {
          const reversible_block_object* obj = nullptr;
          while( (block_num <= last_block) && (obj = reversible_blocks->find<reversible_block_object,by_num>(block_num)) ) {
-            if (as_json_array && contains_obj)
-               *out << ",";
-            auto next = obj->get_block();
-            print_block(next);
+            queue_block(obj->get_block());
             ++block_num;
-            contains_obj = true;
          }
       }
+      for( const auto& sb : salvaged ) {
+         if( block_num > last_block )
+            break;
+         if( sb.block->block_num() == block_num ) {
+            queue_block(sb.block);
+            ++block_num;
+         }
+      }
+      flush_blocks();
    } else {
       block_num = pack_headers_from;
       std::vector<signed_block_header> headers;
-      while(( block_num < pack_headers_from + pack_headers_interval ) && ( next = block_logger.read_block_by_num( block_num ))) {
+      while(( block_num < pack_headers_from + pack_headers_interval ) && ( next = read_block_by_num( block_num ))) {
          headers.push_back( *next );
          ++block_num;
       }
@@ -192,6 +532,743 @@ void blocklog::read_log() {
       *out << "]";
 }
 
+/**
+ * Reads only the first and last block headers, the index tail and file sizes; neither block_log nor the
+ * reversible chainbase is opened, so this stays fast on cold storage and huge logs.
+ */
+void blocklog::print_info() {
+   block_archive archive( blocks_dir );
+   const uint32_t first = archive.first_block_num();
+   const uint32_t last  = archive.last_block_num();
+   const auto first_header = archive.reader_for( first )->read_block_header( first );
+   const auto last_header  = archive.reader_for( last )->read_block_header( last );
+
+   uint64_t log_bytes = 0, index_bytes = 0, block_bytes = 0;
+   bool consistent = true;
+   for( size_t i = 0; i < archive.chunk_count(); ++i ) {
+      const auto r = archive.chunk_reader( i );
+      log_bytes   += r->log_size;
+      index_bytes += r->index_size;
+      // packed blocks only: minus the preamble and the uint64 trailing every block
+      block_bytes += r->log_size - r->get_block_pos( r->first_block_num() ) - uint64_t(r->index_entries) * sizeof(uint64_t);
+      consistent = consistent && r->index_matches_log();
+   }
+   const uint64_t count = uint64_t(last) - first + 1;
+
+   if( archive.chunked() )
+      std::cout << "chunk directory contains block(s): [ " << first << " - " << last << " ] in " << archive.chunk_count() << " chunk(s)" << std::endl;
+   else
+      std::cout << "block.log and block.index contains block(s): [ " << first << " - " << last << " ]" << std::endl;
+   std::cout << "first block: " << first << " " << first_header.id().str() << " " << string(first_header.timestamp.to_time_point()) << std::endl;
+   std::cout << "last block: " << last << " " << last_header.id().str() << " " << string(last_header.timestamp.to_time_point()) << std::endl;
+   std::cout << "blocks.log size: " << log_bytes << " bytes, blocks.index size: " << index_bytes << " bytes" << std::endl;
+   std::cout << "average block size: " << block_bytes / count << " bytes, index density: "
+             << count * 1024 * 1024 / std::max<uint64_t>( 1, log_bytes ) << " blocks per MiB of log, index "
+             << (consistent ? "matches" : "DOES NOT match") << " the log tail" << std::endl;
+
+   // chainbase is only peeked at: size and, for headered chainbase files, the dirty flag
+   const auto shared_mem = blocks_dir / config::reversible_blocks_dir_name / "shared_memory.bin";
+   if( bfs::exists( shared_mem ) ) {
+      char header[9] = {};
+      std::ifstream f( shared_mem.generic_string().c_str(), std::ios::binary );
+      f.read( header, sizeof(header) );
+      std::cout << "reversible blocks database: " << bfs::file_size( shared_mem ) << " bytes";
+      if( f.gcount() == sizeof(header) && strncmp( header, "EOSIODB", 7 ) == 0 )
+         std::cout << ", dirty flag " << (header[8] ? "set" : "clear");
+      std::cout << std::endl;
+   }
+}
+
+std::vector<std::vector<unpacked_trx>> blocklog::unpack_transactions(const std::vector<signed_block_ptr>& blocks) {
+   std::vector<std::vector<unpacked_trx>> unpacked( blocks.size() );
+   std::vector<std::pair<uint32_t, uint32_t>> tasks;   // (block, receipt) of every packed transaction
+   for( uint32_t b = 0; b < blocks.size(); ++b ) {
+      unpacked[b].resize( blocks[b]->transactions.size() );
+      for( uint32_t r = 0; r < blocks[b]->transactions.size(); ++r )
+         if( blocks[b]->transactions[r].trx.contains<packed_transaction>() )
+            tasks.emplace_back( b, r );
+   }
+   if( tasks.empty() )
+      return unpacked;
+
+   if( !unpack_pool )
+      unpack_pool.reset( new range_pool( threads ) );
+   unpack_pool->run( split_range( 0, tasks.size() - 1, threads ), [&]( uint32_t first, uint32_t last ) {
+      for( uint32_t t = first; t <= last; ++t ) {
+         auto& u = unpacked[tasks[t].first][tasks[t].second];
+         u.trx = blocks[tasks[t].first]->transactions[tasks[t].second].trx.get<packed_transaction>().get_transaction();
+         u.id  = u.trx.id();
+      }
+   });
+   return unpacked;
+}
+
+std::ostream* blocklog::open_output(std::ofstream& output_blocks) {
+   if (output_file.empty())
+      return &std::cout;
+   output_blocks.open(output_file.generic_string().c_str());
+   if (output_blocks.fail()) {
+      std::ostringstream ss;
+      ss << "Unable to open file '" << output_file.string() << "'";
+      throw std::runtime_error(ss.str());
+   }
+   return &output_blocks;
+}
+
+void blocklog::scan_heavy_hitters(const block_archive& reader, uint32_t first, uint32_t last, hitter_windows& windows) {
+   block_decoder decoder;
+   for( uint32_t block_num = first; block_num <= last; ++block_num ) {
+      const auto& block = decoder.decode( reader, block_num );
+      const uint32_t sec = block.timestamp.to_time_point().sec_since_epoch();
+      const uint32_t start = sec - sec % hitters_window;
+      auto itr = windows.find( start );
+      if( itr == windows.end() )
+         itr = windows.emplace( start, hitter_window(hitters_capacity) ).first;
+      auto& w = itr->second;
+
+      ++w.blocks;
+      for( const auto& receipt : block.transactions ) {
+         ++w.transactions;
+         if( !receipt.trx.contains<packed_transaction>() )
+            continue;
+         const auto trx = receipt.trx.get<packed_transaction>().get_transaction();
+         for( const auto& act : trx.actions ) {
+            w.actions.add( hitter_key{act.account.value, act.name.value} );
+            w.contracts.add( hitter_key{act.account.value, 0} );
+            for( const auto& auth : act.authorization )
+               w.actors.add( auth.actor.value );
+         }
+      }
+   }
+}
+
+void blocklog::report_heavy_hitters() {
+   hitter_windows windows;
+
+   if( heavy_hitters ) {
+      block_archive reader( blocks_dir );
+      const uint32_t first = std::max( first_block, reader.first_block_num() );
+      const uint32_t last  = std::min( last_block, reader.last_block_num() );
+      EOS_ASSERT( first <= last, block_log_exception, "No blocks in range [ ${f} - ${l} ]", ("f", first_block)("l", last_block) );
+
+      std::vector<hitter_windows> partial( threads );
+      run_parallel_ranges( reader.split( first, last, threads ), threads, [&]( uint32_t i, uint32_t range_first, uint32_t range_last ) {
+         scan_heavy_hitters( reader, range_first, range_last, partial[i] );
+      });
+      for( const auto& p : partial )
+         merge_hitter_windows( windows, p );
+      ilog( "scanned block(s) [ ${f} - ${l} ]", ("f", first)("l", last) );
+   }
+
+   // without a scan the first loaded file sets the parameters the others must match
+   uint32_t window_seconds = heavy_hitters ? hitters_window : 0;
+   uint32_t capacity = heavy_hitters ? hitters_capacity : 0;
+   for( const auto& f : sketch_in ) {
+      string content;
+      fc::read_file_contents( f.generic_string(), content );
+      fc::datastream<const char*> ds( content.data(), content.size() );
+      hitter_sketch_file loaded;
+      fc::raw::unpack( ds, loaded );
+      EOS_ASSERT( loaded.magic == hitter_sketch_magic, block_log_exception, "${f} is not a heavy hitter sketch file", ("f", f.generic_string()) );
+      if( window_seconds == 0 ) {
+         window_seconds = loaded.window_seconds;
+         capacity = loaded.capacity;
+      }
+      EOS_ASSERT( loaded.window_seconds == window_seconds && loaded.capacity == capacity, block_log_exception,
+                  "${f} was built with a ${w}s window and capacity ${c}, expected a ${ew}s window and capacity ${ec}",
+                  ("f", f.generic_string())("w", loaded.window_seconds)("c", loaded.capacity)("ew", window_seconds)("ec", capacity) );
+      for( auto& w : loaded.windows ) {
+         w.second.actions.rebuild();
+         w.second.contracts.rebuild();
+      }
+      merge_hitter_windows( windows, loaded.windows );
+   }
+
+   if( !sketch_out.empty() ) {
+      hitter_sketch_file file{ hitter_sketch_magic, window_seconds, capacity };
+      file.windows = std::move( windows );
+      auto packed = fc::raw::pack( file );
+      windows = std::move( file.windows );
+      std::ofstream sketch_file( sketch_out.generic_string().c_str(), std::ios::binary );
+      EOS_ASSERT( sketch_file.good(), block_log_exception, "Unable to open file '${f}'", ("f", sketch_out.generic_string()) );
+      sketch_file.write( packed.data(), packed.size() );
+      sketch_file.close();
+      EOS_ASSERT( !sketch_file.fail(), block_log_exception, "Error writing '${f}'", ("f", sketch_out.generic_string()) );
+   }
+
+   std::ofstream output_blocks;
+   std::ostream* out = open_output(output_blocks);
+
+   auto hitters_to_variant = [&]( const space_saving& ss, bool with_action ) {
+      fc::variants result;
+      for( const auto& c : ss.top( hitters_top ) ) {
+         fc::mutable_variant_object entry;
+         entry( "contract", name(c.key.account) );
+         if( with_action )
+            entry( "action", name(c.key.action) );
+         entry( "count", c.count )( "error", c.error );
+         result.emplace_back( std::move(entry) );
+      }
+      return result;
+   };
+
+   if (as_json_array)
+      *out << "[";
+   bool contains_obj = false;
+   for( const auto& kv : windows ) {
+      const auto& w = kv.second;
+      if (as_json_array && contains_obj)
+         *out << ",";
+      fc::variant v( fc::mutable_variant_object
+            ("window_start", fc::time_point_sec(kv.first))
+            ("window_seconds", window_seconds)
+            ("blocks", w.blocks)
+            ("transactions", w.transactions)
+            ("actions", w.actions.total)
+            ("distinct_actors", w.actors.estimate())
+            ("top_actions", hitters_to_variant( w.actions, true ))
+            ("top_contracts", hitters_to_variant( w.contracts, false )) );
+      if (no_pretty_print)
+         fc::json::to_stream(*out, v, fc::json::stringify_large_ints_and_doubles);
+      else
+         *out << fc::json::to_pretty_string(v) << "\n";
+      contains_obj = true;
+   }
+   if (as_json_array)
+      *out << "]";
+}
+
+void blocklog::build_sql_rows(const block_archive& reader, block_decoder& decoder, uint32_t block_num, sql_batch& batch) {
+   const auto& block = decoder.decode( reader, block_num );
+
+   sql_block_row br;
+   br.block_num         = block_num;
+   br.id                = block.id().str();
+   br.previous          = block.previous.str();
+   br.timestamp         = fc::variant( block.timestamp ).as_string();
+   br.producer          = block.producer.to_string();
+   br.schedule_version  = block.schedule_version;
+   br.transaction_count = block.transactions.size();
+   br.size              = decoder.buffer.size();
+   batch.blocks.emplace_back( std::move(br) );
+
+   uint32_t trx_seq = 0;
+   for( const auto& receipt : block.transactions ) {
+      sql_trx_row tr;
+      tr.block_num       = block_num;
+      tr.seq             = trx_seq;
+      tr.status          = fc::reflector<transaction_receipt_header::status_enum>::to_string(
+                              static_cast<transaction_receipt_header::status_enum>(receipt.status) );
+      tr.cpu_usage_us    = receipt.cpu_usage_us;
+      tr.net_usage_words = receipt.net_usage_words;
+      if( receipt.trx.contains<packed_transaction>() ) {
+         const auto& ptrx = receipt.trx.get<packed_transaction>();
+         const auto trx = ptrx.get_transaction();
+         tr.id           = trx.id().str();
+         tr.expiration   = fc::variant( trx.expiration ).as_string();
+         tr.action_count = trx.actions.size();
+         tr.packed_size  = fc::raw::pack_size( ptrx );
+
+         uint32_t action_seq = 0;
+         for( const auto& act : trx.actions ) {
+            sql_action_row ar;
+            ar.block_num  = block_num;
+            ar.trx_seq    = trx_seq;
+            ar.action_seq = action_seq++;
+            ar.account    = act.account.to_string();
+            ar.name       = act.name.to_string();
+            for( const auto& auth : act.authorization ) {
+               if( !ar.authorization.empty() )
+                  ar.authorization += ',';
+               ar.authorization += auth.actor.to_string() + '@' + auth.permission.to_string();
+            }
+            ar.data       = act.data;
+            batch.actions.emplace_back( std::move(ar) );
+         }
+      } else {
+         tr.id = receipt.trx.get<transaction_id_type>().str();
+      }
+      batch.transactions.emplace_back( std::move(tr) );
+      ++trx_seq;
+   }
+}
+
+void blocklog::load_sqlite() {
+   block_archive reader( blocks_dir );
+   const uint32_t first = std::max( first_block, reader.first_block_num() );
+   const uint32_t last  = std::min( last_block, reader.last_block_num() );
+   EOS_ASSERT( first <= last, block_log_exception, "No blocks in range [ ${f} - ${l} ]", ("f", first_block)("l", last_block) );
+
+   sqlite_writer writer( sqlite_db );
+   bounded_queue<sql_batch> queue( threads * 2 );
+
+   // single writer drains batches while the decoder threads keep filling the queue
+   std::exception_ptr writer_error;
+   std::thread writer_thread( [&]() {
+      try {
+         sql_batch batch;
+         while( queue.pop( batch ) )
+            writer.write( batch );
+      } catch( ... ) {
+         writer_error = std::current_exception();
+         queue.close();
+      }
+   });
+
+   try {
+      run_parallel_ranges( reader.split( first, last, threads ), threads, [&]( uint32_t, uint32_t range_first, uint32_t range_last ) {
+         sql_batch batch;
+         block_decoder decoder;
+         for( uint32_t block_num = range_first; block_num <= range_last; ++block_num ) {
+            build_sql_rows( reader, decoder, block_num, batch );
+            if( batch.blocks.size() >= sqlite_batch || block_num == range_last ) {
+               if( !queue.push( std::move(batch) ) )
+                  return;
+               batch = sql_batch();
+            }
+         }
+      });
+   } catch( ... ) {
+      queue.close();
+      writer_thread.join();
+      throw;
+   }
+   queue.close();
+   writer_thread.join();
+   if( writer_error )
+      std::rethrow_exception( writer_error );
+
+   writer.finish();
+   ilog( "loaded block(s) [ ${f} - ${l} ] into ${db}: ${r} rows", ("f", first)("l", last)("db", sqlite_db.generic_string())("r", writer.rows) );
+}
+
+chunk_manifest_entry blocklog::write_chunk(const block_archive& source, uint32_t first, uint32_t last) {
+   char name[32];
+   snprintf( name, sizeof(name), "chunk-%010u", first );
+   chunk_manifest_entry entry;
+   entry.directory       = name;
+   entry.first_block_num = first;
+   entry.last_block_num  = last;
+
+   const auto dir = chunks_dir / name;
+   bfs::create_directories( dir );
+   std::ofstream log( (dir / "blocks.log").generic_string().c_str(), std::ios::binary | std::ios::trunc );
+   std::ofstream index( (dir / "blocks.index").generic_string().c_str(), std::ios::binary | std::ios::trunc );
+   EOS_ASSERT( log.good() && index.good(), block_log_exception, "Unable to create chunk in ${d}", ("d", dir.generic_string()) );
+
+   // same genesis as the source log, with first_block_num rewritten so the chunk is a valid log on its own
+   const auto src = source.reader_for( first );
+   auto preamble = src->read_preamble();
+   if( src->version > 1 ) {
+      memcpy( preamble.data() + sizeof(uint32_t), &first, sizeof(first) );
+   } else {
+      // version 1 has no first_block_num; write the version 2 layout: version, first_block_num, genesis, totem
+      const uint32_t version = 2;
+      const uint64_t totem = block_log::npos;
+      std::vector<char> upgraded;
+      upgraded.insert( upgraded.end(), (const char*)&version, (const char*)&version + sizeof(version) );
+      upgraded.insert( upgraded.end(), (const char*)&first, (const char*)&first + sizeof(first) );
+      upgraded.insert( upgraded.end(), preamble.begin() + sizeof(uint32_t), preamble.end() );
+      upgraded.insert( upgraded.end(), (const char*)&totem, (const char*)&totem + sizeof(totem) );
+      preamble = std::move( upgraded );
+   }
+   log.write( preamble.data(), preamble.size() );
+
+   uint64_t pos = preamble.size();
+   std::vector<char> packed;
+   for( uint32_t block_num = first; block_num <= last; ++block_num ) {
+      source.read_block_bytes( block_num, packed );
+      if( block_num == first || block_num == last ) {
+         signed_block_header header;
+         fc::datastream<const char*> ds( packed.data(), packed.size() );
+         fc::raw::unpack( ds, header );
+         if( block_num == first ) {
+            entry.previous = header.previous;
+            entry.first_block_id = header.id();
+         }
+         if( block_num == last )
+            entry.last_block_id = header.id();
+      }
+      log.write( packed.data(), packed.size() );
+      log.write( (const char*)&pos, sizeof(pos) );
+      index.write( (const char*)&pos, sizeof(pos) );
+      pos += packed.size() + sizeof(pos);
+   }
+   log.flush();
+   index.flush();
+   EOS_ASSERT( log.good() && index.good(), block_log_exception, "Error writing chunk ${d}", ("d", dir.generic_string()) );
+   entry.log_size = pos;
+   return entry;
+}
+
+void blocklog::export_chunks() {
+   block_archive source( blocks_dir );
+   const uint32_t first = std::max( first_block, source.first_block_num() );
+   const uint32_t last  = std::min( last_block, source.last_block_num() );
+   EOS_ASSERT( first <= last, block_log_exception, "No blocks in range [ ${f} - ${l} ]", ("f", first_block)("l", last_block) );
+   EOS_ASSERT( !block_archive::is_chunk_dir( chunks_dir ), block_log_exception,
+               "${d} already contains a chunk manifest", ("d", chunks_dir.generic_string()) );
+   bfs::create_directories( chunks_dir );
+
+   std::vector<std::pair<uint32_t, uint32_t>> ranges;
+   for( uint64_t f = first; f <= last; f += export_chunk_size )
+      ranges.emplace_back( f, std::min<uint64_t>( f + export_chunk_size - 1, last ) );
+
+   std::vector<chunk_manifest_entry> manifest( ranges.size() );
+   run_parallel_ranges( ranges, threads, [&]( uint32_t, uint32_t range_first, uint32_t range_last ) {
+      manifest[(range_first - first) / export_chunk_size] = write_chunk( source, range_first, range_last );
+   });
+   fc::json::save_to_file( manifest, chunks_dir / chunk_manifest_name, true );
+   ilog( "exported block(s) [ ${f} - ${l} ] as ${n} chunk(s) into ${d}", ("f", first)("l", last)("n", manifest.size())("d", chunks_dir.generic_string()) );
+}
+
+void blocklog::verify_chunks() {
+   block_archive archive( blocks_dir );
+   EOS_ASSERT( archive.chunked(), block_log_exception, "${d} is not a chunk directory", ("d", blocks_dir.generic_string()) );
+   const auto& manifest = archive.manifest;
+
+   std::vector<std::pair<uint32_t, uint32_t>> ranges;
+   for( const auto& m : manifest )
+      ranges.emplace_back( m.first_block_num, m.last_block_num );
+
+   // every chunk is checked on its own: header links inside the chunk and the ids recorded in the manifest
+   std::vector<string> errors( manifest.size() );
+   run_parallel_ranges( ranges, threads, [&]( uint32_t, uint32_t range_first, uint32_t range_last ) {
+      const size_t i = std::lower_bound( ranges.begin(), ranges.end(), std::make_pair( range_first, range_last ) ) - ranges.begin();
+      const auto& m = manifest[i];
+      try {
+         block_id_type prev = m.previous;
+         std::vector<char> packed;
+         for( uint32_t block_num = range_first; block_num <= range_last && errors[i].empty(); ++block_num ) {
+            archive.read_block_bytes( block_num, packed );
+            signed_block_header header;
+            fc::datastream<const char*> ds( packed.data(), packed.size() );
+            fc::raw::unpack( ds, header );
+            if( header.block_num() != block_num )
+               errors[i] = "block " + std::to_string(block_num) + " has block number " + std::to_string(header.block_num());
+            else if( header.previous != prev )
+               errors[i] = "block " + std::to_string(block_num) + " does not link to its predecessor";
+            prev = header.id();
+            if( block_num == range_first && errors[i].empty() && prev != m.first_block_id )
+               errors[i] = "first block id does not match the manifest";
+         }
+         if( errors[i].empty() && prev != m.last_block_id )
+            errors[i] = "last block id does not match the manifest";
+      } catch( const fc::exception& e ) {
+         errors[i] = e.to_string();
+      }
+   });
+
+   std::ofstream output_blocks;
+   std::ostream* out = open_output(output_blocks);
+   uint32_t failed = 0;
+   for( size_t i = 0; i < manifest.size(); ++i ) {
+      if( errors[i].empty() && i > 0 && manifest[i].previous != manifest[i - 1].last_block_id )
+         errors[i] = "does not link to the last block of " + manifest[i - 1].directory;
+      *out << manifest[i].directory << " [ " << manifest[i].first_block_num << " - " << manifest[i].last_block_num << " ] "
+           << (errors[i].empty() ? string("OK") : "FAILED: " + errors[i]) << "\n";
+      if( !errors[i].empty() )
+         ++failed;
+   }
+   EOS_ASSERT( failed == 0, block_log_exception, "${n} of ${t} chunk(s) failed verification", ("n", failed)("t", manifest.size()) );
+}
+
+/// raw copy of [0, size) of an open file, in large blocks
+static void write_all(int fd, const char* data, size_t size, const bfs::path& file) {
+   while( size > 0 ) {
+      const auto w = ::write( fd, data, size );
+      if( w < 0 && errno == EINTR )
+         continue;
+      EOS_ASSERT( w > 0, block_log_exception, "Error writing ${f}", ("f", file.generic_string()) );
+      data += w;
+      size -= w;
+   }
+}
+
+static void copy_prefix(int fd, uint64_t size, int dest, const bfs::path& dest_file) {
+   std::vector<char> buf( 4 * 1024 * 1024 );
+   for( uint64_t pos = 0; pos < size; ) {
+      const uint64_t n = std::min<uint64_t>( buf.size(), size - pos );
+      block_log_reader::read_exact( fd, buf.data(), n, pos );
+      write_all( dest, buf.data(), n, dest_file );
+      pos += n;
+   }
+}
+
+void blocklog::merge_reversible() {
+   block_log_reader source( blocks_dir );
+   const uint32_t head_num = source.last_block_num();
+   const auto head_extent = source.get_block_extent( head_num );
+   const uint64_t log_end = head_extent.first + head_extent.second + sizeof(uint64_t);   // drops any partial write past the head
+   const auto head = source.read_block_header( head_num );
+
+   auto salvage = salvage_reversible_blocks( blocks_dir / config::reversible_blocks_dir_name, head_num, head.id() );
+   if( !salvage.stop_reason.empty() )
+      wlog( "reversible salvage stopped: ${r}", ("r", salvage.stop_reason) );
+   while( !salvage.blocks.empty() && salvage.blocks.back().block->block_num() > last_block )
+      salvage.blocks.pop_back();
+
+   EOS_ASSERT( !bfs::exists( merge_reversible_dir / "blocks.log" ), block_log_exception,
+               "${d} already contains a block log", ("d", merge_reversible_dir.generic_string()) );
+   bfs::create_directories( merge_reversible_dir );
+
+   // both files are written and synced under temporary names, then renamed, index first: a blocks.log in the
+   // output directory always comes with its complete index
+   const bfs::path log_file = merge_reversible_dir / "blocks.log", index_file = merge_reversible_dir / "blocks.index";
+   const bfs::path log_tmp = log_file.string() + ".tmp", index_tmp = index_file.string() + ".tmp";
+   int log_fd = -1, index_fd = -1;
+   try {
+      log_fd = ::open( log_tmp.generic_string().c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+      EOS_ASSERT( log_fd >= 0, block_log_exception, "Unable to create ${f}", ("f", log_tmp.generic_string()) );
+      index_fd = ::open( index_tmp.generic_string().c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+      EOS_ASSERT( index_fd >= 0, block_log_exception, "Unable to create ${f}", ("f", index_tmp.generic_string()) );
+
+      // the existing log is copied byte for byte, the reversible blocks are appended exactly as they were stored
+      copy_prefix( source.log_fd, log_end, log_fd, log_tmp );
+      copy_prefix( source.index_fd, uint64_t(source.index_entries) * sizeof(uint64_t), index_fd, index_tmp );
+      uint64_t pos = log_end;
+      for( const auto& sb : salvage.blocks ) {
+         write_all( log_fd, sb.packed.data(), sb.packed.size(), log_tmp );
+         write_all( log_fd, (const char*)&pos, sizeof(pos), log_tmp );
+         write_all( index_fd, (const char*)&pos, sizeof(pos), index_tmp );
+         pos += sb.packed.size() + sizeof(pos);
+      }
+
+      EOS_ASSERT( ::fsync( log_fd ) == 0 && ::fsync( index_fd ) == 0, block_log_exception,
+                  "Unable to sync block log in ${d}", ("d", merge_reversible_dir.generic_string()) );
+      const int log_rc = ::close( log_fd ), index_rc = ::close( index_fd );
+      log_fd = index_fd = -1;
+      EOS_ASSERT( log_rc == 0 && index_rc == 0, block_log_exception, "Error writing block log in ${d}", ("d", merge_reversible_dir.generic_string()) );
+      bfs::rename( index_tmp, index_file );
+      bfs::rename( log_tmp, log_file );
+   } catch( ... ) {
+      if( log_fd >= 0 )
+         ::close( log_fd );
+      if( index_fd >= 0 )
+         ::close( index_fd );
+      boost::system::error_code ec;
+      bfs::remove( log_tmp, ec );
+      bfs::remove( index_tmp, ec );
+      throw;
+   }
+   const int dir_fd = ::open( merge_reversible_dir.generic_string().c_str(), O_RDONLY | O_DIRECTORY );
+   EOS_ASSERT( dir_fd >= 0, block_log_exception, "Unable to open ${d}", ("d", merge_reversible_dir.generic_string()) );
+   const int dir_rc = ::fsync( dir_fd );
+   ::close( dir_fd );
+   EOS_ASSERT( dir_rc == 0, block_log_exception, "Unable to sync ${d}", ("d", merge_reversible_dir.generic_string()) );
+
+   const uint32_t last = salvage.blocks.empty() ? head_num : salvage.blocks.back().block->block_num();
+   ilog( "wrote block(s) [ ${f} - ${l} ] into ${d}: ${n} reversible block(s) appended after block ${h}",
+         ("f", source.first_block_num())("l", last)("d", merge_reversible_dir.generic_string())("n", salvage.blocks.size())("h", head_num) );
+}
+
+void blocklog::write_replay() {
+   block_archive archive( blocks_dir );
+   const uint32_t first = std::max( first_block, archive.first_block_num() );
+   const uint32_t last  = std::min( last_block, archive.last_block_num() );
+   EOS_ASSERT( first <= last, block_log_exception, "No blocks in range [ ${f} - ${l} ]", ("f", first_block)("l", last_block) );
+
+   std::unordered_set<uint64_t> accounts;
+   for( const auto& a : replay_accounts )
+      accounts.insert( account_name( a ).value );
+   // a transaction matches if any action is sent to or authorized by one of the accounts
+   auto matches = [&]( const packed_transaction& ptrx ) {
+      if( accounts.empty() )
+         return true;
+      const auto trx = ptrx.get_transaction();
+      for( const auto& act : trx.actions ) {
+         if( accounts.count( act.account.value ) )
+            return true;
+         for( const auto& auth : act.authorization )
+            if( accounts.count( auth.actor.value ) )
+               return true;
+      }
+      return false;
+   };
+
+   replay_file_writer writer( replay_out );
+   block_decoder decoder;
+   vector<std::vector<char>> trxs;
+   fc::time_point start;
+   for( uint32_t block_num = first; block_num <= last; ++block_num ) {
+      const auto& block = decoder.decode( archive, block_num );
+      const auto ts = block.timestamp.to_time_point();
+      if( block_num == first )
+         start = ts;
+      trxs.clear();
+      // only transactions that were applied; failed and deferred-only receipts carry no replayable workload
+      for( const auto& receipt : block.transactions ) {
+         if( receipt.status != transaction_receipt_header::executed || !receipt.trx.contains<packed_transaction>() )
+            continue;
+         const auto& ptrx = receipt.trx.get<packed_transaction>();
+         if( matches( ptrx ) )
+            trxs.emplace_back( fc::raw::pack( ptrx ) );
+      }
+      if( !trxs.empty() )
+         writer.write_block( block_num, (ts - start).count(), trxs );
+   }
+   writer.finish();
+   ilog( "wrote ${t} transaction(s) from ${b} block(s) of [ ${f} - ${l} ] to ${o}",
+         ("t", writer.transactions)("b", writer.blocks)("f", first)("l", last)("o", replay_out.generic_string()) );
+}
+
+void blocklog::read_replay() {
+   replay_file_reader reader( replay_in );
+   replay_pacer pacer( replay_speed );
+   std::ofstream output_blocks;
+   std::ostream* out = open_output(output_blocks);
+
+   replay_block b;
+   uint64_t blocks = 0, trxs = 0, bytes = 0;
+   int64_t max_lag = 0;
+   const auto start = fc::time_point::now();
+   while( reader.next( b ) ) {
+      const int64_t lag = pacer.wait( b.offset_us );
+      max_lag = std::max( max_lag, lag );
+      for( uint32_t i = 0; i < b.trx_count; ++i )
+         bytes += b.trxs[i].size();
+      if( !no_pretty_print )
+         *out << b.block_num << " +" << b.offset_us / 1000 << "ms " << b.trx_count << " trx(s) lag " << lag << "us\n";
+      ++blocks;
+      trxs += b.trx_count;
+   }
+   const double secs = std::max<int64_t>( 1, (fc::time_point::now() - start).count() ) / 1e6;
+   *out << "blocks: " << blocks << ", transactions: " << trxs << ", bytes: " << bytes << ", seconds: " << secs
+        << ", trx/s: " << uint64_t(trxs / secs) << ", max lag: " << max_lag << "us" << std::endl;
+}
+
+void blocklog::report_sample() {
+   block_archive archive( blocks_dir );
+   const uint32_t first = std::max( first_block, archive.first_block_num() );
+   const uint32_t last  = std::min( last_block, archive.last_block_num() );
+   EOS_ASSERT( first <= last, block_log_exception, "No blocks in range [ ${f} - ${l} ]", ("f", first_block)("l", last_block) );
+   const uint64_t population = uint64_t(last) - first + 1;
+
+   std::vector<uint32_t> block_nums;
+   if( sample_every > 0 ) {
+      for( uint64_t n = first; n <= last; n += sample_every )
+         block_nums.push_back( n );
+   } else if( sample_size >= population ) {
+      for( uint64_t n = first; n <= last; ++n )
+         block_nums.push_back( n );
+   } else {
+      // Floyd's algorithm: sample_size distinct block numbers, uniformly without replacement
+      std::mt19937_64 rng( sample_seed ? sample_seed : std::random_device()() );
+      std::unordered_set<uint32_t> chosen;
+      for( uint64_t j = population - sample_size; j < population; ++j ) {
+         const uint64_t t = std::uniform_int_distribution<uint64_t>( 0, j )( rng );
+         if( !chosen.insert( first + t ).second )
+            chosen.insert( first + j );
+      }
+      block_nums.assign( chosen.begin(), chosen.end() );
+   }
+   std::sort( block_nums.begin(), block_nums.end() );   // ascending offsets are kinder to the device
+
+   sample_stat transactions, actions, block_size, packed_trx_size, cpu_usage_us, net_usage_words;
+   // per (contract, action) sums over the sampled blocks, with a its count in a block and x the block's action
+   // count; enough for the ratio estimator's variance without keeping anything per block
+   struct mix_sums {
+      uint64_t   a = 0;
+      double     aa = 0;
+      double     ax = 0;
+   };
+   std::unordered_map<hitter_key, mix_sums, hitter_key_hash> mix_totals;
+   double xx = 0;
+
+   const auto start = fc::time_point::now();
+   block_fetcher fetcher( archive, io_depth, threads );
+   fetcher.fetch( block_nums, false, [&]( uint32_t, const signed_block_ptr& block, uint64_t packed_size ) {
+      std::unordered_map<hitter_key, uint32_t, hitter_key_hash> mix;
+      uint64_t block_actions = 0, trx_bytes = 0, cpu = 0, net = 0;
+      for( const auto& receipt : block->transactions ) {
+         cpu += receipt.cpu_usage_us;
+         net += receipt.net_usage_words;
+         if( !receipt.trx.contains<packed_transaction>() )
+            continue;
+         const auto& ptrx = receipt.trx.get<packed_transaction>();
+         trx_bytes += fc::raw::pack_size( ptrx );
+         const auto trx = ptrx.get_transaction();
+         for( const auto& act : trx.actions )
+            ++mix[hitter_key{act.account.value, act.name.value}];
+         block_actions += trx.actions.size();
+      }
+      transactions.add( block->transactions.size() );
+      actions.add( block_actions );
+      block_size.add( packed_size );
+      packed_trx_size.add( trx_bytes );
+      cpu_usage_us.add( cpu );
+      net_usage_words.add( net );
+
+      const double x = block_actions;
+      xx += x * x;
+      for( const auto& m : mix ) {
+         auto& t = mix_totals[m.first];
+         t.a  += m.second;
+         t.aa += double(m.second) * m.second;
+         t.ax += m.second * x;
+      }
+   });
+
+   // 95% normal interval with the finite population correction
+   const double n = block_nums.size();
+   const double fpc = population > 1 ? double(population - block_nums.size()) / (population - 1) : 0;
+   const double z = 1.96;
+   auto stat_to_variant = [&]( const sample_stat& st ) {
+      const double se = std::sqrt( fpc * st.variance() / n );
+      return fc::mutable_variant_object
+            ("mean", st.mean)
+            ("stderr", se)
+            ("ci95_low", st.mean - z * se)
+            ("ci95_high", st.mean + z * se)
+            ("estimated_total", st.mean * population);
+   };
+
+   // share of each (contract, action) among all actions: ratio estimator over sampled blocks
+   std::vector<std::pair<hitter_key, mix_sums>> top( mix_totals.begin(), mix_totals.end() );
+   std::sort( top.begin(), top.end(), []( const std::pair<hitter_key, mix_sums>& a, const std::pair<hitter_key, mix_sums>& b ) {
+      return a.second.a > b.second.a;
+   });
+   if( top.size() > hitters_top )
+      top.resize( hitters_top );
+   const double total_actions = actions.mean * n;
+   fc::variants action_mix;
+   for( const auto& t : top ) {
+      const double r = total_actions > 0 ? t.second.a / total_actions : 0;
+      // sum over blocks of (a - r x)^2, expanded
+      const double ss = std::max( 0.0, t.second.aa - 2 * r * t.second.ax + r * r * xx );
+      const double se = (n > 1 && actions.mean > 0) ? std::sqrt( fpc * ss / (n - 1) / n ) / actions.mean : 0;
+      action_mix.emplace_back( fc::mutable_variant_object
+            ("contract", name(t.first.account))
+            ("action", name(t.first.action))
+            ("sampled", t.second.a)
+            ("share", r)
+            ("ci95_low", std::max( 0.0, r - z * se ))
+            ("ci95_high", std::min( 1.0, r + z * se ))
+            ("estimated_total", r * actions.mean * population) );
+   }
+
+   std::ofstream output_blocks;
+   std::ostream* out = open_output(output_blocks);
+   fc::variant v( fc::mutable_variant_object
+         ("first_block", first)
+         ("last_block", last)
+         ("population", population)
+         ("samples", block_nums.size())
+         ("method", sample_every > 0 ? "strided" : "uniform")
+         ("elapsed_ms", (fc::time_point::now() - start).count() / 1000)
+         ("transactions_per_block", stat_to_variant( transactions ))
+         ("actions_per_block", stat_to_variant( actions ))
+         ("block_size", stat_to_variant( block_size ))
+         ("packed_trx_bytes_per_block", stat_to_variant( packed_trx_size ))
+         ("cpu_usage_us_per_block", stat_to_variant( cpu_usage_us ))
+         ("net_usage_words_per_block", stat_to_variant( net_usage_words ))
+         ("action_mix", action_mix) );
+   if (no_pretty_print)
+      fc::json::to_stream(*out, v, fc::json::stringify_large_ints_and_doubles);
+   else
+      *out << fc::json::to_pretty_string(v) << "\n";
+}
+
 void blocklog::set_program_options(options_description& cli)
 {
    cli.add_options()
@@ -208,7 +1285,7 @@ void blocklog::set_program_options(options_description& cli)
          ("as-json-array", bpo::bool_switch(&as_json_array)->default_value(false),
           "Print out json blocks wrapped in json array (otherwise the output is free-standing json objects).")
          ("info,i", bpo::bool_switch(&info)->default_value(false),
-          "Only print the first and last block number in forkdb of current chain.")
+          "Only print the block range, first/last block ids and timestamps, file sizes and index consistency, reading nothing but the index tail and two block headers.")
          ("print-packed-header", bpo::bool_switch(&print_packed_header)->default_value(false),
           "Print packed header.")
          ("print-packed-trx", bpo::bool_switch(&print_packed_trx)->default_value(false),
@@ -219,6 +1296,58 @@ void blocklog::set_program_options(options_description& cli)
           "Packed headers amount.")
          ("pack-headers-times", bpo::value<uint32_t>(&pack_headers_times)->default_value(1),
           "Print Packed headers times.")
+         ("heavy-hitters", bpo::bool_switch(&heavy_hitters)->default_value(false),
+          "Report the busiest contracts and actions and the distinct actor count per time window, using bounded-memory sketches.")
+         ("hitters-window", bpo::value<uint32_t>(&hitters_window)->default_value(86400),
+          "Heavy hitter time window in seconds.")
+         ("hitters-top", bpo::value<uint32_t>(&hitters_top)->default_value(20),
+          "Number of contracts and actions to report per window.")
+         ("hitters-capacity", bpo::value<uint32_t>(&hitters_capacity)->default_value(1000),
+          "Counters kept per window sketch; keys more frequent than total/capacity are always reported.")
+         ("sketch-in", bpo::value<std::vector<bfs::path>>()->composing()->multitoken(),
+          "Merge heavy hitter sketches saved by --sketch-out (may be repeated, may be used without --heavy-hitters); "
+          "all of them must have been built with the same --hitters-window and --hitters-capacity.")
+         ("sketch-out", bpo::value<bfs::path>(),
+          "Save the merged heavy hitter sketches to this file so runs over different ranges can be combined.")
+         ("sqlite-db", bpo::value<bfs::path>(),
+          "Load blocks, transactions and actions into this SQLite file instead of printing them.")
+         ("sqlite-batch", bpo::value<uint32_t>(&sqlite_batch)->default_value(1000),
+          "Blocks per SQLite transaction.")
+         ("export-chunks", bpo::value<uint32_t>(&export_chunk_size)->default_value(0),
+          "Split the block log into self-contained chunks of this many blocks, written to --chunks-dir with a manifest.json. "
+          "A chunk directory can be given as --blocks-dir to every reader mode.")
+         ("chunks-dir", bpo::value<bfs::path>()->default_value("chunks"),
+          "Output directory for --export-chunks.")
+         ("verify-chunks", bpo::bool_switch(&verify_chunks_only)->default_value(false),
+          "Verify every chunk of the chunk directory given as --blocks-dir against its manifest entry, one chunk per thread.")
+         ("block-list", bpo::value<bfs::path>(),
+          "Print only the blocks whose numbers are listed in this file (whitespace separated), fetching them with many reads in flight.")
+         ("completion-order", bpo::bool_switch(&completion_order)->default_value(false),
+          "With --block-list, print blocks as their reads complete instead of in list order.")
+         ("io-depth", bpo::value<uint32_t>(&io_depth)->default_value(64),
+          "Block reads kept in flight by --block-list.")
+         ("sample", bpo::value<uint32_t>(&sample_size)->default_value(0),
+          "Estimate per-block statistics and the action mix from this many uniformly random blocks, with 95% confidence intervals.")
+         ("sample-every", bpo::value<uint32_t>(&sample_every)->default_value(0),
+          "Like --sample, but read every K-th block of the range instead of a random subset.")
+         ("sample-seed", bpo::value<uint64_t>(&sample_seed)->default_value(0),
+          "Random seed for --sample (0 picks a random seed).")
+         ("salvage-reversible", bpo::bool_switch(&salvage_reversible)->default_value(false),
+          "Recover the blocks following the log head from the reversible database even when its dirty flag is set, "
+          "keeping only entries that unpack and chain to the log head.")
+         ("merge-reversible", bpo::value<bfs::path>(),
+          "Write blocks.log / blocks.index to this directory: the block log followed by the valid reversible blocks past its head, "
+          "appended as stored without re-serializing.")
+         ("replay-out", bpo::value<bfs::path>(),
+          "Write the executed transactions of the block range to this replay file, grouped by block with their relative timing.")
+         ("replay-account", bpo::value<std::vector<string>>(&replay_accounts)->composing()->multitoken(),
+          "With --replay-out, keep only transactions with an action sent to or authorized by one of these accounts.")
+         ("replay-in", bpo::value<bfs::path>(),
+          "Stream this replay file, one line per block, paced by --replay-speed.")
+         ("replay-speed", bpo::value<double>(&replay_speed)->default_value(1),
+          "Replay speed factor for --replay-in (1 = original timing, 10 = ten times faster, 0 = as fast as possible).")
+         ("threads,t", bpo::value<uint32_t>(&threads)->default_value(std::max(1u, std::thread::hardware_concurrency())),
+          "Number of worker threads for scans.")
          ("help,h", "Print this help message and exit.")
          ;
 
@@ -239,6 +1368,45 @@ void blocklog::initialize(const variables_map& options) {
          else
             output_file = bld;
       }
+
+      if (options.count( "sketch-in" ))
+         sketch_in = options.at( "sketch-in" ).as<std::vector<bfs::path>>();
+      if (options.count( "sketch-out" ))
+         sketch_out = options.at( "sketch-out" ).as<bfs::path>();
+      bld = options.at( "chunks-dir" ).as<bfs::path>();
+      if( bld.is_relative())
+         chunks_dir = bfs::current_path() / bld;
+      else
+         chunks_dir = bld;
+
+      if (options.count( "merge-reversible" )) {
+         bld = options.at( "merge-reversible" ).as<bfs::path>();
+         if( bld.is_relative())
+            merge_reversible_dir = bfs::current_path() / bld;
+         else
+            merge_reversible_dir = bld;
+      }
+
+      if (options.count( "replay-out" ))
+         replay_out = options.at( "replay-out" ).as<bfs::path>();
+      if (options.count( "replay-in" ))
+         replay_in = options.at( "replay-in" ).as<bfs::path>();
+
+      if (options.count( "block-list" ))
+         block_list = options.at( "block-list" ).as<bfs::path>();
+
+      if (options.count( "sqlite-db" )) {
+         bld = options.at( "sqlite-db" ).as<bfs::path>();
+         if( bld.is_relative())
+            sqlite_db = bfs::current_path() / bld;
+         else
+            sqlite_db = bld;
+      }
+      EOS_ASSERT( sqlite_batch > 0, fc::invalid_arg_exception, "--sqlite-batch must be positive" );
+      EOS_ASSERT( hitters_window > 0, fc::invalid_arg_exception, "--hitters-window must be positive" );
+      EOS_ASSERT( hitters_capacity > 0, fc::invalid_arg_exception, "--hitters-capacity must be positive" );
+      EOS_ASSERT( threads > 0, fc::invalid_arg_exception, "--threads must be positive" );
+      EOS_ASSERT( replay_speed >= 0, fc::invalid_arg_exception, "--replay-speed must not be negative" );
    } FC_LOG_AND_RETHROW()
 
 }
@@ -259,7 +1427,24 @@ int main(int argc, char** argv)
          return 0;
       }
       blog.initialize(vmap);
-      blog.read_log();
+      if (blog.export_chunk_size > 0)
+         blog.export_chunks();
+      else if (blog.verify_chunks_only)
+         blog.verify_chunks();
+      else if (!blog.merge_reversible_dir.empty())
+         blog.merge_reversible();
+      else if (!blog.replay_out.empty())
+         blog.write_replay();
+      else if (!blog.replay_in.empty())
+         blog.read_replay();
+      else if (blog.sample_size > 0 || blog.sample_every > 0)
+         blog.report_sample();
+      else if (!blog.sqlite_db.empty())
+         blog.load_sqlite();
+      else if (blog.heavy_hitters || !blog.sketch_in.empty())
+         blog.report_heavy_hitters();
+      else
+         blog.read_log();
    } catch( const fc::exception& e ) {
       elog( "${e}", ("e", e.to_detail_string()));
       return -1;
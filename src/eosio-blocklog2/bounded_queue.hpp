@@ -0,0 +1,59 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace eosio {
+    namespace chain {
+
+       /**
+        *  Blocking multi-producer / multi-consumer queue with a fixed capacity, so fast producers
+        *  stall instead of buffering an unbounded amount of decoded data.
+        *  close() wakes everybody up; pop() keeps returning items until the queue drains.
+        */
+       template<typename T>
+       struct bounded_queue {
+          explicit bounded_queue( size_t capacity ) : capacity(capacity) {}
+
+          /// returns false if the queue was closed
+          bool push( T&& item ) {
+             std::unique_lock<std::mutex> lock( mtx );
+             not_full.wait( lock, [&]() { return closed || items.size() < capacity; } );
+             if( closed )
+                return false;
+             items.push_back( std::move(item) );
+             not_empty.notify_one();
+             return true;
+          }
+
+          /// returns false once the queue is closed and empty
+          bool pop( T& item ) {
+             std::unique_lock<std::mutex> lock( mtx );
+             not_empty.wait( lock, [&]() { return closed || !items.empty(); } );
+             if( items.empty() )
+                return false;
+             item = std::move( items.front() );
+             items.pop_front();
+             not_full.notify_one();
+             return true;
+          }
+
+          void close() {
+             std::lock_guard<std::mutex> lock( mtx );
+             closed = true;
+             not_full.notify_all();
+             not_empty.notify_all();
+          }
+
+       private:
+          size_t                  capacity;
+          bool                    closed = false;
+          std::deque<T>           items;
+          std::mutex              mtx;
+          std::condition_variable not_full;
+          std::condition_variable not_empty;
+       };
+
+    }
+} /// namespace eosio::chain
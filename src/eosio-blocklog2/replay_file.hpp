@@ -0,0 +1,145 @@
+#pragma once
+
+#include <eosio/chain/exceptions.hpp>
+
+#include <boost/filesystem/path.hpp>
+
+#include <chrono>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+namespace eosio {
+    namespace chain {
+
+       /**
+        *  Traffic replay file: packed transactions grouped by the block they were included in.
+        *
+        *  Layout: uint64 magic, uint32 version, then one record per block:
+        *  uint32 block_num, int64 offset of the block timestamp from the first block in microseconds,
+        *  uint32 transaction count, and per transaction a uint32 size followed by the packed_transaction
+        *  exactly as it was stored in the block.
+        */
+       const uint64_t replay_file_magic   = 0x31594c5052534f45ull;   // "EOSRPLY1"
+       const uint32_t replay_file_version = 1;
+
+       struct replay_block {
+          uint32_t                         block_num = 0;
+          int64_t                          offset_us = 0;
+          vector<std::vector<char>>        trxs;          ///< only the first trx_count entries are valid
+          uint32_t                         trx_count = 0;
+       };
+
+       struct replay_file_writer {
+          explicit replay_file_writer( const boost::filesystem::path& file )
+          :out( file.generic_string().c_str(), std::ios::binary | std::ios::trunc ) {
+             EOS_ASSERT( out.good(), block_log_exception, "Unable to create ${f}", ("f", file.generic_string()) );
+             out.write( (const char*)&replay_file_magic, sizeof(replay_file_magic) );
+             out.write( (const char*)&replay_file_version, sizeof(replay_file_version) );
+          }
+
+          /// `trxs` are already packed packed_transactions
+          void write_block( uint32_t block_num, int64_t offset_us, const vector<std::vector<char>>& trxs ) {
+             const uint32_t count = trxs.size();
+             out.write( (const char*)&block_num, sizeof(block_num) );
+             out.write( (const char*)&offset_us, sizeof(offset_us) );
+             out.write( (const char*)&count, sizeof(count) );
+             for( const auto& t : trxs ) {
+                const uint32_t size = t.size();
+                out.write( (const char*)&size, sizeof(size) );
+                out.write( t.data(), t.size() );
+             }
+             ++blocks;
+             transactions += count;
+          }
+
+          void finish() {
+             out.flush();
+             EOS_ASSERT( out.good(), block_log_exception, "Error writing replay file" );
+          }
+
+          uint64_t        blocks = 0;
+          uint64_t        transactions = 0;
+
+       private:
+          std::ofstream   out;
+       };
+
+       /**
+        *  Sequential reader for replay files.  The stream is read through a large buffer and the
+        *  transaction buffers of replay_block are reused from block to block, so streaming costs one
+        *  copy per transaction and no allocation once warmed up.
+        */
+       struct replay_file_reader {
+          explicit replay_file_reader( const boost::filesystem::path& file ) {
+             in.rdbuf()->pubsetbuf( buffer.data(), buffer.size() );
+             in.open( file.generic_string().c_str(), std::ios::binary );
+             EOS_ASSERT( in.good(), block_log_exception, "Unable to open ${f}", ("f", file.generic_string()) );
+             uint64_t magic = 0;
+             uint32_t version = 0;
+             read( &magic, sizeof(magic) );
+             read( &version, sizeof(version) );
+             EOS_ASSERT( magic == replay_file_magic && version == replay_file_version, block_log_exception,
+                         "${f} is not a version ${v} replay file", ("f", file.generic_string())("v", replay_file_version) );
+          }
+
+          /// returns false at the end of the file
+          bool next( replay_block& b ) {
+             if( in.peek() == std::char_traits<char>::eof() )
+                return false;
+             read( &b.block_num, sizeof(b.block_num) );
+             read( &b.offset_us, sizeof(b.offset_us) );
+             read( &b.trx_count, sizeof(b.trx_count) );
+             if( b.trxs.size() < b.trx_count )
+                b.trxs.resize( b.trx_count );
+             for( uint32_t i = 0; i < b.trx_count; ++i ) {
+                uint32_t size = 0;
+                read( &size, sizeof(size) );
+                b.trxs[i].resize( size );
+                read( b.trxs[i].data(), size );
+             }
+             return true;
+          }
+
+       private:
+          void read( void* dst, size_t size ) {
+             in.read( static_cast<char*>(dst), size );
+             EOS_ASSERT( size_t(in.gcount()) == size, block_log_exception, "Truncated replay file" );
+          }
+
+          std::vector<char>   buffer = std::vector<char>( 4 * 1024 * 1024 );
+          std::ifstream       in;
+       };
+
+       /**
+        *  Paces a replay against the wall clock: wait() returns once the block offset, divided by the speed
+        *  factor, has elapsed since the first call.  A speed of 0 never waits.
+        */
+       struct replay_pacer {
+          explicit replay_pacer( double speed ) : speed(speed) {}
+
+          /// returns how late the block is in microseconds (0 if on time or unpaced)
+          int64_t wait( int64_t offset_us ) {
+             if( speed <= 0 )
+                return 0;
+             const auto now = std::chrono::steady_clock::now();
+             if( !started ) {
+                start = now;
+                started = true;
+             }
+             const auto due = start + std::chrono::microseconds( int64_t(offset_us / speed) );
+             if( due > now ) {
+                std::this_thread::sleep_until( due );
+                return 0;
+             }
+             return std::chrono::duration_cast<std::chrono::microseconds>( now - due ).count();
+          }
+
+       private:
+          double                                  speed;
+          bool                                    started = false;
+          std::chrono::steady_clock::time_point   start;
+       };
+
+    }
+} /// namespace eosio::chain
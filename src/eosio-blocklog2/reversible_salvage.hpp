@@ -0,0 +1,151 @@
+#pragma once
+
+#include <eosio/chain/reversible_block_object.hpp>
+
+#include <boost/core/demangle.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/managed_external_buffer.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <cstring>
+
+#include "block_log_reader.hpp"
+
+namespace eosio {
+    namespace chain {
+
+       /// headered chainbase files ("EOSIODB", version, dirty flag ...) keep the managed segment behind this many bytes
+       const size_t chainbase_header_size = 1024;
+
+       struct salvaged_block {
+          signed_block_ptr     block;
+          block_id_type        id;
+          std::vector<char>    packed;     ///< raw bytes as stored in the reversible database
+       };
+
+       struct reversible_salvage {
+          vector<salvaged_block>  blocks;        ///< validated chain continuing the given head
+          uint32_t                entries = 0;   ///< index entries visited
+          uint32_t                skipped = 0;   ///< entries at or below the head
+          string                  stop_reason;   ///< why the walk ended early, empty if every entry was used
+       };
+
+       /**
+        *  Recover reversible blocks from reversible_blocks/shared_memory.bin regardless of its dirty flags.
+        *
+        *  The file is mapped copy-on-write, so it is never modified and only the pages actually touched are read,
+        *  instead of opening chainbase with the full reversible cache size.  Both the plain layout and headered
+        *  chainbase files, whose segment starts after the header, are understood.  The by_num index is walked
+        *  defensively: every object and packed block must lie inside the mapping, block numbers must be
+        *  increasing and contiguous, each packed block must unpack to the expected number and link to the
+        *  previous block id, starting from head_id.  The walk stops at the first entry that fails.
+        */
+       inline reversible_salvage salvage_reversible_blocks( const boost::filesystem::path& reversible_dir,
+                                                            uint32_t head_num, const block_id_type& head_id ) {
+          namespace bip = boost::interprocess;
+          reversible_salvage result;
+
+          const auto file = reversible_dir / "shared_memory.bin";
+          EOS_ASSERT( boost::filesystem::exists( file ), block_log_exception, "${f} does not exist", ("f", file.generic_string()) );
+          bip::file_mapping mapping( file.generic_string().c_str(), bip::read_only );
+          bip::mapped_region region( mapping, bip::copy_on_write );
+          const char* file_base = static_cast<const char*>( region.get_address() );
+          const size_t file_size = region.get_size();
+          const size_t offset = file_size >= 7 && memcmp( file_base, "EOSIODB", 7 ) == 0 ? chainbase_header_size : 0;
+          EOS_ASSERT( file_size > offset, block_log_exception, "${f} is too small to hold a database", ("f", file.generic_string()) );
+
+          const char* base = file_base + offset;
+          const size_t size = file_size - offset;
+          auto in_segment = [&]( const void* p, size_t n ) {
+             const char* c = static_cast<const char*>( p );
+             return c >= base && n <= size && c <= base + size - n;
+          };
+
+          // chainbase registers every index under the demangled name of its value type
+          using index_type = chainbase::generic_index<reversible_block_index>;
+          const index_type* idx = nullptr;
+          try {
+             bip::managed_external_buffer segment( bip::open_only, const_cast<char*>( base ), size );
+             EOS_ASSERT( segment.get_size() <= size, block_log_exception, "${f}: segment larger than the file", ("f", file.generic_string()) );
+             const auto type_name = boost::core::demangle( typeid(reversible_block_object).name() );
+             idx = segment.find_no_lock<index_type>( type_name.c_str() ).first;
+          } catch( const fc::exception& e ) {
+             result.stop_reason = "unreadable segment: " + e.to_string();
+             return result;
+          } catch( const std::exception& e ) {
+             result.stop_reason = string( "unreadable segment: " ) + e.what();
+             return result;
+          }
+          if( !idx || !in_segment( idx, sizeof(*idx) ) ) {
+             result.stop_reason = "reversible block index not found";
+             return result;
+          }
+
+          // a corrupt index ends the walk with a reason instead of the whole tool
+          try {
+             const auto& by_block_num = idx->indices().get<by_num>();
+             const size_t expected = by_block_num.size();
+             uint32_t prev_num = 0;
+             uint32_t next_num = head_num + 1;
+             block_id_type prev_id = head_id;
+             for( auto itr = by_block_num.begin(); itr != by_block_num.end(); ++itr ) {
+                if( result.entries++ >= expected ) {
+                   result.stop_reason = "index holds more entries than it claims";
+                   break;
+                }
+                const reversible_block_object& obj = *itr;
+                if( !in_segment( &obj, sizeof(obj) ) ) {
+                   result.stop_reason = "index entry outside the mapped file";
+                   break;
+                }
+                if( result.entries > 1 && obj.blocknum <= prev_num ) {
+                   result.stop_reason = "index entries out of order at block " + std::to_string( obj.blocknum );
+                   break;
+                }
+                prev_num = obj.blocknum;
+                if( obj.blocknum < next_num ) {
+                   ++result.skipped;
+                   continue;
+                }
+                if( obj.blocknum != next_num ) {
+                   result.stop_reason = "missing block " + std::to_string( next_num );
+                   break;
+                }
+
+                const char* data = obj.packedblock.data();
+                const size_t data_size = obj.packedblock.size();
+                if( !in_segment( data, data_size ) ) {
+                   result.stop_reason = "packed block " + std::to_string( next_num ) + " outside the mapped file";
+                   break;
+                }
+                salvaged_block sb;
+                try {
+                   sb.block = block_log_reader::unpack_block( data, data_size );
+                } catch( const fc::exception& e ) {
+                   result.stop_reason = "block " + std::to_string( next_num ) + " does not unpack: " + e.to_string();
+                   break;
+                }
+                if( sb.block->block_num() != next_num ) {
+                   result.stop_reason = "entry " + std::to_string( next_num ) + " holds block " + std::to_string( sb.block->block_num() );
+                   break;
+                }
+                if( sb.block->previous != prev_id ) {
+                   result.stop_reason = "block " + std::to_string( next_num ) + " does not link to the previous block";
+                   break;
+                }
+                sb.id = sb.block->id();
+                sb.packed.assign( data, data + data_size );
+                prev_id = sb.id;
+                ++next_num;
+                result.blocks.emplace_back( std::move(sb) );
+             }
+          } catch( const fc::exception& e ) {
+             result.stop_reason = "index walk failed at entry " + std::to_string( result.entries ) + ": " + e.to_string();
+          } catch( const std::exception& e ) {
+             result.stop_reason = "index walk failed at entry " + std::to_string( result.entries ) + ": " + e.what();
+          }
+          return result;
+       }
+
+    }
+} /// namespace eosio::chain
@@ -0,0 +1,207 @@
+#pragma once
+
+#include <fc/reflect/reflect.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace eosio {
+    namespace chain {
+       using namespace std;
+
+       inline uint64_t mix64( uint64_t x ) {
+          x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+          x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+          x ^= x >> 31;
+          return x;
+       }
+
+       /// (contract account, action name); action is 0 when only contracts are counted
+       struct hitter_key {
+          uint64_t account = 0;
+          uint64_t action  = 0;
+
+          friend bool operator == ( const hitter_key& a, const hitter_key& b ) {
+             return a.account == b.account && a.action == b.action;
+          }
+       };
+
+       struct hitter_key_hash {
+          size_t operator()( const hitter_key& k )const { return mix64( k.account ^ mix64( k.action ) ); }
+       };
+
+       struct hitter_counter {
+          hitter_key key;
+          uint64_t   count = 0;
+          uint64_t   error = 0;
+       };
+
+       /**
+        *  Space-saving heavy hitter summary (Metwally et al.) holding at most `capacity` counters.
+        *  Any key whose true frequency exceeds total/capacity is guaranteed to be present; for every
+        *  reported key  count - error <= true count <= count.
+        *
+        *  Counters live in a min-heap so the eviction victim is always counters[0].
+        */
+       struct space_saving {
+          space_saving( uint32_t capacity = 1000 ) : capacity(capacity) {}
+
+          void add( const hitter_key& key, uint64_t weight = 1 ) {
+             total += weight;
+             auto itr = positions.find( key );
+             if( itr != positions.end() ) {
+                counters[itr->second].count += weight;
+                sift_down( itr->second );
+             } else if( counters.size() < capacity ) {
+                counters.push_back( hitter_counter{key, weight, 0} );
+                positions[key] = counters.size() - 1;
+                sift_up( counters.size() - 1 );
+             } else {
+                auto& victim = counters[0];
+                positions.erase( victim.key );
+                victim.error = victim.count;
+                victim.count += weight;
+                victim.key = key;
+                positions[key] = 0;
+                sift_down( 0 );
+             }
+          }
+
+          /// upper bound on the count of any key that is not tracked
+          uint64_t min_count()const {
+             return counters.empty() || counters.size() < capacity ? 0 : counters[0].count;
+          }
+
+          /// merge of two summaries (Agarwal et al., "Mergeable Summaries"); error bounds add up
+          void merge( const space_saving& other ) {
+             const uint64_t m1 = min_count();
+             const uint64_t m2 = other.min_count();
+             std::unordered_map<hitter_key, hitter_counter, hitter_key_hash> combined;
+             for( const auto& c : counters ) {
+                auto o = other.positions.find( c.key );
+                if( o != other.positions.end() ) {
+                   const auto& oc = other.counters[o->second];
+                   combined[c.key] = hitter_counter{c.key, c.count + oc.count, c.error + oc.error};
+                } else {
+                   combined[c.key] = hitter_counter{c.key, c.count + m2, c.error + m2};
+                }
+             }
+             for( const auto& c : other.counters ) {
+                if( !positions.count( c.key ) )
+                   combined[c.key] = hitter_counter{c.key, c.count + m1, c.error + m1};
+             }
+             counters.clear();
+             for( auto& kv : combined )
+                counters.push_back( kv.second );
+             if( counters.size() > capacity ) {
+                std::nth_element( counters.begin(), counters.begin() + capacity, counters.end(), by_count_desc );
+                counters.resize( capacity );
+             }
+             total += other.total;
+             rebuild();
+          }
+
+          /// counters ordered by descending count
+          vector<hitter_counter> top( uint32_t k )const {
+             vector<hitter_counter> result( counters );
+             std::sort( result.begin(), result.end(), by_count_desc );
+             if( result.size() > k )
+                result.resize( k );
+             return result;
+          }
+
+          /// restore the heap and the key index after counters were unpacked or rewritten
+          void rebuild() {
+             std::make_heap( counters.begin(), counters.end(), by_count_desc );
+             positions.clear();
+             for( size_t i = 0; i < counters.size(); ++i )
+                positions[counters[i].key] = i;
+          }
+
+          uint32_t                                                    capacity = 1000;
+          uint64_t                                                    total = 0;
+          vector<hitter_counter>                                      counters;
+          std::unordered_map<hitter_key, uint32_t, hitter_key_hash>   positions;
+
+       private:
+          static bool by_count_desc( const hitter_counter& a, const hitter_counter& b ) { return a.count > b.count; }
+
+          void swap_counters( size_t a, size_t b ) {
+             std::swap( counters[a], counters[b] );
+             positions[counters[a].key] = a;
+             positions[counters[b].key] = b;
+          }
+
+          void sift_up( size_t i ) {
+             while( i > 0 ) {
+                size_t parent = (i - 1) / 2;
+                if( counters[parent].count <= counters[i].count ) break;
+                swap_counters( i, parent );
+                i = parent;
+             }
+          }
+
+          void sift_down( size_t i ) {
+             const size_t n = counters.size();
+             while( true ) {
+                size_t smallest = i, l = 2 * i + 1, r = l + 1;
+                if( l < n && counters[l].count < counters[smallest].count ) smallest = l;
+                if( r < n && counters[r].count < counters[smallest].count ) smallest = r;
+                if( smallest == i ) break;
+                swap_counters( i, smallest );
+                i = smallest;
+             }
+          }
+       };
+
+       /**
+        *  HyperLogLog distinct counter with 2^14 registers (~0.8% standard error, 16KB).
+        *  Two sketches merge by taking the register-wise maximum.
+        */
+       struct hyperloglog {
+          static constexpr uint32_t precision = 14;
+          static constexpr uint32_t num_registers = 1u << precision;
+
+          hyperloglog() : registers( num_registers, 0 ) {}
+
+          void add( uint64_t value ) {
+             const uint64_t h = mix64( value );
+             const uint32_t idx = h >> (64 - precision);
+             const uint64_t rest = (h << precision) | (1ULL << (precision - 1));
+             const uint8_t rank = __builtin_clzll( rest ) + 1;
+             if( rank > registers[idx] )
+                registers[idx] = rank;
+          }
+
+          void merge( const hyperloglog& other ) {
+             for( uint32_t i = 0; i < num_registers; ++i )
+                registers[i] = std::max( registers[i], other.registers[i] );
+          }
+
+          uint64_t estimate()const {
+             const double m = num_registers;
+             double sum = 0;
+             uint32_t zeros = 0;
+             for( auto r : registers ) {
+                sum += std::ldexp( 1.0, -int(r) );
+                if( r == 0 ) ++zeros;
+             }
+             double e = (0.7213 / (1 + 1.079 / m)) * m * m / sum;
+             if( e <= 2.5 * m && zeros > 0 )
+                e = m * std::log( m / zeros );   // linear counting for small cardinalities
+             return uint64_t( e + 0.5 );
+          }
+
+          vector<uint8_t> registers;
+       };
+
+    }
+} /// namespace eosio::chain
+
+FC_REFLECT(eosio::chain::hitter_key,     (account)(action))
+FC_REFLECT(eosio::chain::hitter_counter, (key)(count)(error))
+FC_REFLECT(eosio::chain::space_saving,   (capacity)(total)(counters))
+FC_REFLECT(eosio::chain::hyperloglog,    (registers))
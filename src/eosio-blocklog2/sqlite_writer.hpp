@@ -0,0 +1,214 @@
+#pragma once
+
+#include <fc/exception/exception.hpp>
+
+#include <boost/filesystem/path.hpp>
+
+#include <sqlite3.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace eosio {
+    namespace chain {
+       using namespace std;
+
+       struct sql_block_row {
+          uint32_t      block_num = 0;
+          string        id;
+          string        previous;
+          string        timestamp;
+          string        producer;
+          uint32_t      schedule_version = 0;
+          uint32_t      transaction_count = 0;
+          uint32_t      size = 0;
+       };
+
+       struct sql_trx_row {
+          string        id;
+          uint32_t      block_num = 0;
+          uint32_t      seq = 0;
+          string        status;
+          uint32_t      cpu_usage_us = 0;
+          uint32_t      net_usage_words = 0;
+          string        expiration;
+          uint32_t      action_count = 0;
+          uint32_t      packed_size = 0;
+       };
+
+       struct sql_action_row {
+          uint32_t      block_num = 0;
+          uint32_t      trx_seq = 0;
+          uint32_t      action_seq = 0;
+          string        account;
+          string        name;
+          string        authorization;
+          vector<char>  data;
+       };
+
+       /// rows decoded from a run of blocks; written by the writer thread as a single sqlite transaction
+       struct sql_batch {
+          vector<sql_block_row>   blocks;
+          vector<sql_trx_row>     transactions;
+          vector<sql_action_row>  actions;
+       };
+
+       /**
+        *  Bulk loader for a local SQLite file.
+        *
+        *  The database runs in WAL mode with synchronous=OFF while loading, every insert goes through a
+        *  prepared statement, each batch is one transaction, and secondary indexes are only created by
+        *  finish() once all rows are in.  Loading a range again into an existing file replaces its rows.
+        */
+       struct sqlite_writer {
+          explicit sqlite_writer( const boost::filesystem::path& file ) {
+             try {
+                check( sqlite3_open( file.generic_string().c_str(), &db ), "open" );
+                exec( "PRAGMA journal_mode=WAL" );
+                exec( "PRAGMA synchronous=OFF" );
+                exec( "PRAGMA temp_store=MEMORY" );
+                exec( "PRAGMA cache_size=-262144" );
+                exec( "CREATE TABLE IF NOT EXISTS blocks("
+                      "block_num INTEGER PRIMARY KEY, id TEXT, previous TEXT, timestamp TEXT, producer TEXT, "
+                      "schedule_version INTEGER, transaction_count INTEGER, size INTEGER)" );
+                exec( "CREATE TABLE IF NOT EXISTS transactions("
+                      "id TEXT, block_num INTEGER, seq INTEGER, status TEXT, cpu_usage_us INTEGER, "
+                      "net_usage_words INTEGER, expiration TEXT, action_count INTEGER, packed_size INTEGER)" );
+                exec( "CREATE TABLE IF NOT EXISTS actions("
+                      "block_num INTEGER, trx_seq INTEGER, action_seq INTEGER, account TEXT, name TEXT, "
+                      "authorization TEXT, data BLOB)" );
+                insert_block  = prepare( "INSERT OR REPLACE INTO blocks VALUES(?,?,?,?,?,?,?,?)" );
+                insert_trx    = prepare( "INSERT INTO transactions VALUES(?,?,?,?,?,?,?,?,?)" );
+                insert_action = prepare( "INSERT INTO actions VALUES(?,?,?,?,?,?,?)" );
+                // transactions and actions have no key to replace on, the rows of the batch's blocks are dropped first
+                delete_trxs    = prepare( "DELETE FROM transactions WHERE block_num BETWEEN ? AND ?" );
+                delete_actions = prepare( "DELETE FROM actions WHERE block_num BETWEEN ? AND ?" );
+             } catch( ... ) {
+                // the destructor does not run for a throwing constructor
+                close();
+                throw;
+             }
+          }
+
+          ~sqlite_writer() {
+             close();
+          }
+
+          sqlite_writer( const sqlite_writer& ) = delete;
+          sqlite_writer& operator=( const sqlite_writer& ) = delete;
+
+          void write( const sql_batch& batch ) {
+             exec( "BEGIN" );
+             try {
+                write_rows( batch );
+             } catch( ... ) {
+                for( auto stmt : { insert_block, insert_trx, insert_action, delete_trxs, delete_actions } )
+                   sqlite3_reset( stmt );
+                sqlite3_exec( db, "ROLLBACK", nullptr, nullptr, nullptr );
+                throw;
+             }
+             exec( "COMMIT" );
+             rows += batch.blocks.size() + batch.transactions.size() + batch.actions.size();
+          }
+
+          /// deferred index creation, then switch back to durable settings
+          void finish() {
+             exec( "CREATE INDEX IF NOT EXISTS transactions_id ON transactions(id)" );
+             exec( "CREATE INDEX IF NOT EXISTS transactions_block_num ON transactions(block_num)" );
+             exec( "CREATE INDEX IF NOT EXISTS actions_block_num ON actions(block_num, trx_seq)" );
+             exec( "CREATE INDEX IF NOT EXISTS actions_account_name ON actions(account, name)" );
+             exec( "PRAGMA synchronous=NORMAL" );
+             exec( "PRAGMA wal_checkpoint(TRUNCATE)" );
+          }
+
+          uint64_t rows = 0;
+
+       private:
+          /// finalizing or closing a null handle is a no-op, so this is safe on a partly opened writer
+          void close() {
+             for( auto stmt : { insert_block, insert_trx, insert_action, delete_trxs, delete_actions } )
+                sqlite3_finalize( stmt );
+             sqlite3_close( db );
+          }
+
+          void write_rows( const sql_batch& batch ) {
+             if( !batch.blocks.empty() ) {
+                const auto range = std::minmax_element( batch.blocks.begin(), batch.blocks.end(),
+                                                        []( const sql_block_row& a, const sql_block_row& b ) { return a.block_num < b.block_num; } );
+                for( auto stmt : { delete_trxs, delete_actions } ) {
+                   sqlite3_bind_int64( stmt, 1, range.first->block_num );
+                   sqlite3_bind_int64( stmt, 2, range.second->block_num );
+                   step( stmt );
+                }
+             }
+             for( const auto& r : batch.blocks ) {
+                sqlite3_bind_int64( insert_block, 1, r.block_num );
+                bind_text( insert_block, 2, r.id );
+                bind_text( insert_block, 3, r.previous );
+                bind_text( insert_block, 4, r.timestamp );
+                bind_text( insert_block, 5, r.producer );
+                sqlite3_bind_int64( insert_block, 6, r.schedule_version );
+                sqlite3_bind_int64( insert_block, 7, r.transaction_count );
+                sqlite3_bind_int64( insert_block, 8, r.size );
+                step( insert_block );
+             }
+             for( const auto& r : batch.transactions ) {
+                bind_text( insert_trx, 1, r.id );
+                sqlite3_bind_int64( insert_trx, 2, r.block_num );
+                sqlite3_bind_int64( insert_trx, 3, r.seq );
+                bind_text( insert_trx, 4, r.status );
+                sqlite3_bind_int64( insert_trx, 5, r.cpu_usage_us );
+                sqlite3_bind_int64( insert_trx, 6, r.net_usage_words );
+                bind_text( insert_trx, 7, r.expiration );
+                sqlite3_bind_int64( insert_trx, 8, r.action_count );
+                sqlite3_bind_int64( insert_trx, 9, r.packed_size );
+                step( insert_trx );
+             }
+             for( const auto& r : batch.actions ) {
+                sqlite3_bind_int64( insert_action, 1, r.block_num );
+                sqlite3_bind_int64( insert_action, 2, r.trx_seq );
+                sqlite3_bind_int64( insert_action, 3, r.action_seq );
+                bind_text( insert_action, 4, r.account );
+                bind_text( insert_action, 5, r.name );
+                bind_text( insert_action, 6, r.authorization );
+                sqlite3_bind_blob( insert_action, 7, r.data.data(), r.data.size(), SQLITE_STATIC );
+                step( insert_action );
+             }
+          }
+
+          void check( int rc, const char* what ) {
+             FC_ASSERT( rc == SQLITE_OK || rc == SQLITE_DONE || rc == SQLITE_ROW,
+                        "sqlite ${w} failed: ${e}", ("w", what)("e", db ? sqlite3_errmsg(db) : sqlite3_errstr(rc)) );
+          }
+
+          void exec( const char* sql ) {
+             check( sqlite3_exec( db, sql, nullptr, nullptr, nullptr ), sql );
+          }
+
+          sqlite3_stmt* prepare( const char* sql ) {
+             sqlite3_stmt* stmt = nullptr;
+             check( sqlite3_prepare_v2( db, sql, -1, &stmt, nullptr ), sql );
+             return stmt;
+          }
+
+          void step( sqlite3_stmt* stmt ) {
+             const int rc = sqlite3_step( stmt );
+             sqlite3_reset( stmt );
+             check( rc, sqlite3_sql( stmt ) );
+          }
+
+          static void bind_text( sqlite3_stmt* stmt, int col, const string& s ) {
+             sqlite3_bind_text( stmt, col, s.data(), s.size(), SQLITE_STATIC );
+          }
+
+          sqlite3*      db = nullptr;
+          sqlite3_stmt* insert_block = nullptr;
+          sqlite3_stmt* insert_trx = nullptr;
+          sqlite3_stmt* insert_action = nullptr;
+          sqlite3_stmt* delete_trxs = nullptr;
+          sqlite3_stmt* delete_actions = nullptr;
+       };
+
+    }
+} /// namespace eosio::chain
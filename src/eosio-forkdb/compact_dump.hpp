@@ -0,0 +1,115 @@
+#pragma once
+
+#include <eosio/chain/block_state.hpp>
+
+#include <fc/crypto/sha256.hpp>
+#include <fc/io/json.hpp>
+#include <fc/io/raw.hpp>
+#include <fc/variant_object.hpp>
+
+#include <functional>
+#include <map>
+
+namespace eosio {
+    namespace chain {
+
+       /**
+        *  Delta encoder for consecutive block_states.
+        *
+        *  Producer schedules are interned: the first time a schedule is seen it is emitted once as
+        *  {"schedule_ref": k, "schedule": {...}} and blocks refer to it by k, only when their active or pending
+        *  schedule changes.  blockroot_merkle is emitted as the node count plus the active nodes that differ
+        *  from the previous block.  Every other block_header_state field is emitted only when its value changed;
+        *  the header itself is always emitted.  The first block of a dump carries everything.
+        */
+       struct compact_dumper {
+          using emitter = std::function<void( fc::variant&& )>;
+
+          explicit compact_dumper( emitter emit ) : emit( std::move(emit) ) {}
+
+          void dump( const block_state& s ) {
+             fc::mutable_variant_object o;
+             o( "block_num", s.block_num )( "id", s.id )( "header", s.header );
+
+             const uint32_t active  = intern( s.active_schedule );
+             const uint32_t pending = intern( s.pending_schedule );
+             if( first || active != prev_active )
+                o( "active_schedule", active );
+             if( first || pending != prev_pending )
+                o( "pending_schedule", pending );
+             prev_active  = active;
+             prev_pending = pending;
+
+             merkle_delta( s.blockroot_merkle, o );
+
+             // remaining fields through reflection, so fields added to block_header_state are picked up too
+             fc::reflector<block_header_state>::visit( field_visitor{ *this, s, o } );
+             first = false;
+             emit( fc::variant( std::move(o) ) );
+          }
+
+       private:
+          /// compares the packed value of each field with the previous block, converting only changed ones
+          struct field_visitor {
+             compact_dumper&                dumper;
+             const block_header_state&      state;
+             fc::mutable_variant_object&    out;
+
+             template<typename Member, class Class, Member (Class::*member)>
+             void operator()( const char* name )const {
+                if( skipped_field( name ) )
+                   return;
+                auto packed = fc::raw::pack( state.*member );
+                auto& prev = dumper.prev_fields[name];
+                if( dumper.first || packed != prev ) {
+                   out( name, state.*member );
+                   prev = std::move( packed );
+                }
+             }
+          };
+
+          static bool skipped_field( const string& key ) {
+             return key == "id" || key == "block_num" || key == "header" || key == "active_schedule" ||
+                    key == "pending_schedule" || key == "blockroot_merkle";
+          }
+
+          uint32_t intern( const producer_schedule_type& schedule ) {
+             const auto h = fc::sha256::hash( schedule );
+             auto itr = schedules.find( h );
+             if( itr != schedules.end() )
+                return itr->second;
+             const uint32_t ref = schedules.size();
+             schedules.emplace( h, ref );
+             emit( fc::variant( fc::mutable_variant_object( "schedule_ref", ref )( "schedule", schedule ) ) );
+             return ref;
+          }
+
+          void merkle_delta( const incremental_merkle& m, fc::mutable_variant_object& o ) {
+             if( first ) {
+                o( "blockroot_merkle", m );
+             } else {
+                vector<fc::variant> changed;
+                for( size_t i = 0; i < m._active_nodes.size(); ++i )
+                   if( i >= prev_merkle._active_nodes.size() || m._active_nodes[i] != prev_merkle._active_nodes[i] )
+                      changed.emplace_back( fc::variants{ fc::variant( i ), fc::variant( m._active_nodes[i] ) } );
+                fc::mutable_variant_object d;
+                d( "node_count", m._node_count );
+                if( m._active_nodes.size() != prev_merkle._active_nodes.size() )
+                   d( "active_nodes", m._active_nodes.size() );
+                d( "changed", changed );
+                o( "blockroot_merkle_delta", std::move(d) );
+             }
+             prev_merkle = m;
+          }
+
+          emitter                             emit;
+          bool                                first = true;
+          std::map<fc::sha256, uint32_t>      schedules;
+          uint32_t                            prev_active = 0;
+          uint32_t                            prev_pending = 0;
+          incremental_merkle                  prev_merkle;
+          std::map<string, bytes>             prev_fields;
+       };
+
+    }
+} /// namespace eosio::chain
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <mutex>
+
+#include "forkdb_reader.hpp"
+
+namespace eosio {
+    namespace chain {
+
+       /**
+        *  Union of the fork databases of several nodes, keyed by block id.
+        *
+        *  Every distinct block is stored once with a bitset of the nodes holding it, so memory grows with
+        *  the number of distinct blocks rather than with the number of files.  add() may be called from
+        *  several threads; link() must be called once all nodes are in.
+        */
+       struct fork_graph {
+          struct block {
+             block_id_type   id;
+             block_id_type   previous;
+             uint32_t        block_num = 0;
+             account_name    producer;
+             int64_t         parent = -1;
+          };
+
+          /// a run of blocks between a fork point (or root) and a tip
+          struct segment {
+             uint32_t        tip = 0;
+             uint32_t        base = 0;
+             int64_t         fork_point = -1;   ///< block the segment grows from, -1 at a root
+             uint32_t        length = 0;
+          };
+
+          explicit fork_graph( uint32_t nodes ) : nodes(nodes), words((nodes + 63) / 64), heads(nodes, -1) {}
+
+          void add( uint32_t node, const forkdb_reader& reader ) {
+             std::lock_guard<std::mutex> lock( mtx );
+             for( const auto& e : reader.entries ) {
+                auto itr = by_id.find( e.id );
+                uint32_t b;
+                if( itr == by_id.end() ) {
+                   b = blocks.size();
+                   blocks.push_back( block{ e.id, e.previous, e.block_num, e.producer } );
+                   holder_bits.resize( holder_bits.size() + words, 0 );
+                   by_id.emplace( e.id, b );
+                } else {
+                   b = itr->second;
+                }
+                holder_bits[size_t(b) * words + node / 64] |= uint64_t(1) << (node % 64);
+             }
+             if( reader.head >= 0 )
+                heads[node] = by_id.at( reader.head_id );
+          }
+
+          bool holds( uint32_t block, uint32_t node )const {
+             return holder_bits[size_t(block) * words + node / 64] & (uint64_t(1) << (node % 64));
+          }
+
+          /// resolves parents, finds the common ancestor of all heads and cuts the graph into segments
+          void link() {
+             vector<uint32_t> child_count( blocks.size(), 0 );
+             for( auto& b : blocks ) {
+                auto itr = by_id.find( b.previous );
+                b.parent = itr == by_id.end() ? -1 : int64_t(itr->second);
+                if( b.parent >= 0 )
+                   ++child_count[b.parent];
+             }
+
+             // a block is an ancestor of every head if every head chain passes through it
+             vector<uint32_t> on_chains( blocks.size(), 0 );
+             uint32_t live_heads = 0;
+             for( int64_t h : heads ) {
+                if( h < 0 )
+                   continue;
+                ++live_heads;
+                for( int64_t i = h; i >= 0; i = blocks[i].parent )
+                   ++on_chains[i];
+             }
+             for( size_t i = 0; i < blocks.size(); ++i )
+                if( live_heads > 0 && on_chains[i] == live_heads && (common_ancestor < 0 || blocks[i].block_num > blocks[common_ancestor].block_num) )
+                   common_ancestor = i;
+
+             // segments end at tips and start after a fork point; each block belongs to one segment
+             segment_of.assign( blocks.size(), -1 );
+             for( size_t i = 0; i < blocks.size(); ++i ) {
+                if( child_count[i] != 0 )
+                   continue;
+                int64_t j = i;
+                for(;;) {
+                   segment s;
+                   s.tip = j;
+                   for( ; j >= 0 && segment_of[j] < 0; ) {
+                      segment_of[j] = segments.size();
+                      s.base = j;
+                      ++s.length;
+                      j = blocks[j].parent;
+                      if( j >= 0 && child_count[j] > 1 )
+                         break;
+                   }
+                   s.fork_point = j;
+                   segments.push_back( s );
+                   // continue below the fork point unless another tip already claimed it
+                   if( j < 0 || segment_of[j] >= 0 )
+                      break;
+                }
+             }
+          }
+
+          const uint32_t                                             nodes;
+          const uint32_t                                             words;
+          vector<block>                                              blocks;
+          vector<uint64_t>                                           holder_bits;   ///< `words` per block
+          std::unordered_map<block_id_type, uint32_t, block_id_hash> by_id;
+          vector<int64_t>                                            heads;         ///< head block per node
+          int64_t                                                    common_ancestor = -1;
+          vector<segment>                                            segments;
+          vector<int64_t>                                            segment_of;
+
+       private:
+          std::mutex                                                 mtx;
+       };
+
+    }
+} /// namespace eosio::chain
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <fc/io/json.hpp>
+#include <fc/variant_object.hpp>
+
+#include <ostream>
+
+#include "forkdb_reader.hpp"
+
+namespace eosio {
+    namespace chain {
+
+       /**
+        *  Fork tree of a forkdb.dat, built in time linear in the number of blocks (plus sorting the leaves),
+        *  over the reader's entry indexes:
+        *  parent links through the id index, children as one flat array grouped by parent (counting sort),
+        *  the head chain marked by walking up from the head, and every block off the head chain assigned to
+        *  exactly one branch.
+        */
+       struct fork_tree {
+          /// a run of blocks off the head chain, from the block after `divergence` up to `tip`
+          struct branch {
+             uint32_t                tip = 0;
+             uint32_t                base = 0;           ///< first block of the branch
+             int64_t                 divergence = -1;    ///< block the branch grows from, -1 if its parent is not in the file
+             bool                    from_head_chain = false;
+             uint32_t                length = 0;
+             vector<account_name>    producers;          ///< distinct producers, tip first
+          };
+
+          explicit fork_tree( const forkdb_reader& reader ) : reader(reader) {
+             const auto& entries = reader.entries;
+             const size_t n = entries.size();
+
+             parent.resize( n );
+             vector<uint32_t> child_count( n + 1, 0 );
+             for( size_t i = 0; i < n; ++i ) {
+                parent[i] = reader.find( entries[i].previous );
+                if( parent[i] >= 0 )
+                   ++child_count[parent[i] + 1];
+                else
+                   roots.push_back( i );
+             }
+             child_begin.resize( n + 1, 0 );
+             for( size_t i = 0; i < n; ++i )
+                child_begin[i + 1] = child_begin[i] + child_count[i + 1];
+             children.resize( child_begin[n] );
+             vector<uint32_t> fill( child_begin.begin(), child_begin.end() - 1 );
+             for( size_t i = 0; i < n; ++i )
+                if( parent[i] >= 0 )
+                   children[fill[parent[i]]++] = i;
+
+             on_head_chain.assign( n, false );
+             for( int64_t i = reader.head; i >= 0 && !on_head_chain[i]; i = parent[i] )
+                on_head_chain[i] = true;
+
+             // leaves other than the head, highest first, so the longest branch of a fork claims the shared part
+             branch_of.assign( n, -1 );
+             vector<uint32_t> leaves;
+             for( size_t i = 0; i < n; ++i )
+                if( !on_head_chain[i] && child_begin[i] == child_begin[i + 1] )
+                   leaves.push_back( i );
+             std::sort( leaves.begin(), leaves.end(), [&]( uint32_t a, uint32_t b ) { return entries[a].block_num > entries[b].block_num; } );
+             for( auto leaf : leaves ) {
+                branch b;
+                b.tip = leaf;
+                int64_t i = leaf;
+                for( ; i >= 0 && !on_head_chain[i] && branch_of[i] < 0; i = parent[i] ) {
+                   branch_of[i] = branches.size();
+                   b.base = i;
+                   ++b.length;
+                   if( std::find( b.producers.begin(), b.producers.end(), entries[i].producer ) == b.producers.end() )
+                      b.producers.push_back( entries[i].producer );
+                }
+                b.divergence = i;
+                b.from_head_chain = i >= 0 && on_head_chain[i];
+                branches.emplace_back( std::move(b) );
+             }
+          }
+
+          /// the head chain block a branch ultimately grows from, through the branches it is nested in; -1 if none
+          int64_t head_chain_ancestor( const branch& b )const {
+             int64_t i = b.divergence;
+             while( i >= 0 && !on_head_chain[i] )
+                i = branches[branch_of[i]].divergence;
+             return i;
+          }
+
+          /// number of head chain blocks between the branch's head chain ancestor and the head
+          uint32_t depth( const branch& b )const {
+             const int64_t a = head_chain_ancestor( b );
+             if( a < 0 || reader.head < 0 )
+                return 0;
+             return reader.entries[reader.head].block_num - reader.entries[a].block_num;
+          }
+
+          fc::variant branch_to_variant( const branch& b )const {
+             const auto& e = reader.entries;
+             fc::mutable_variant_object o;
+             o( "tip_block_num", e[b.tip].block_num )( "tip_id", e[b.tip].id )
+              ( "base_block_num", e[b.base].block_num )( "length", b.length )( "producers", b.producers );
+             if( b.divergence >= 0 ) {
+                o( "divergence_block_num", e[b.divergence].block_num )( "divergence_id", e[b.divergence].id )
+                 ( "from_head_chain", b.from_head_chain );
+                if( !b.from_head_chain )
+                   o( "parent_branch", branch_of[b.divergence] );
+                const int64_t a = head_chain_ancestor( b );
+                if( a >= 0 )
+                   o( "head_chain_block_num", e[a].block_num )( "depth_below_head", depth( b ) );
+             }
+             return fc::variant( std::move(o) );
+          }
+
+          void print_text( std::ostream& out )const {
+             const auto& e = reader.entries;
+             uint32_t head_chain = 0;
+             for( bool b : on_head_chain )
+                head_chain += b;
+             out << "blocks: " << e.size() << ", roots: " << roots.size() << ", head chain: " << head_chain
+                 << ", branches: " << branches.size() << "\n";
+             if( reader.head >= 0 )
+                out << "head: " << e[reader.head].block_num << " " << e[reader.head].id.str() << "\n";
+             for( size_t i = 0; i < branches.size(); ++i ) {
+                const auto& b = branches[i];
+                out << "branch " << i << ": [ " << e[b.base].block_num << " - " << e[b.tip].block_num << " ] length " << b.length
+                    << " tip " << e[b.tip].id.str() << " producers";
+                for( const auto& p : b.producers )
+                   out << " " << p.to_string();
+                if( b.divergence < 0 )
+                   out << ", parent not in forkdb";
+                else if( b.from_head_chain )
+                   out << ", grows from head chain at " << e[b.divergence].block_num << " (" << depth( b ) << " below head)";
+                else {
+                   out << ", grows from branch " << branch_of[b.divergence] << " at " << e[b.divergence].block_num;
+                   const int64_t a = head_chain_ancestor( b );
+                   if( a >= 0 )
+                      out << ", head chain at " << e[a].block_num << " (" << depth( b ) << " below head)";
+                   else
+                      out << ", not connected to the head chain";
+                }
+                out << "\n";
+             }
+          }
+
+          void print_json( std::ostream& out, bool pretty )const {
+             const auto& e = reader.entries;
+             vector<fc::variant> blocks;
+             blocks.reserve( e.size() );
+             for( size_t i = 0; i < e.size(); ++i )
+                blocks.emplace_back( fc::mutable_variant_object
+                   ( "block_num", e[i].block_num )( "id", e[i].id )( "previous", e[i].previous )( "producer", e[i].producer )
+                   ( "head_chain", bool(on_head_chain[i]) )( "branch", branch_of[i] ) );
+             vector<fc::variant> bs;
+             for( const auto& b : branches )
+                bs.emplace_back( branch_to_variant( b ) );
+             fc::mutable_variant_object o;
+             if( reader.head >= 0 )
+                o( "head_block_num", e[reader.head].block_num )( "head_id", e[reader.head].id );
+             o( "branches", bs )( "blocks", blocks );
+             fc::variant v( std::move(o) );
+             if( pretty )
+                out << fc::json::to_pretty_string( v ) << "\n";
+             else
+                out << fc::json::to_string( v ) << "\n";
+          }
+
+          /// Graphviz, parent -> child, head chain in bold
+          void print_dot( std::ostream& out )const {
+             const auto& e = reader.entries;
+             out << "digraph forkdb {\n  rankdir=LR;\n  node [shape=box];\n";
+             for( size_t i = 0; i < e.size(); ++i ) {
+                out << "  b" << i << " [label=\"" << e[i].block_num << "\\n" << e[i].producer.to_string() << "\\n"
+                    << e[i].id.str().substr( 8, 16 ) << "\"";
+                if( on_head_chain[i] )
+                   out << ", style=bold";
+                if( int64_t(i) == reader.head )
+                   out << ", color=blue";
+                out << "];\n";
+             }
+             for( size_t i = 0; i < e.size(); ++i )
+                for( uint32_t c = child_begin[i]; c < child_begin[i + 1]; ++c )
+                   out << "  b" << i << " -> b" << children[c] << (on_head_chain[children[c]] ? " [style=bold]" : "") << ";\n";
+             out << "}\n";
+          }
+
+          const forkdb_reader&   reader;
+          vector<int64_t>        parent;         ///< entry index of the previous block, -1 if not in the file
+          vector<uint32_t>       child_begin;    ///< children of i are children[child_begin[i] .. child_begin[i + 1])
+          vector<uint32_t>       children;
+          vector<uint32_t>       roots;
+          vector<bool>           on_head_chain;
+          vector<int64_t>        branch_of;      ///< branch index of each entry, -1 on the head chain
+          vector<branch>         branches;
+       };
+
+    }
+} /// namespace eosio::chain
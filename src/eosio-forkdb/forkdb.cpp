@@ -6,7 +6,6 @@
 #include <eosio/chain/block_log.hpp>
 #include <eosio/chain/config.hpp>
 #include <eosio/chain/reversible_block_object.hpp>
-#include <eosio/chain/fork_database.hpp>
 
 #include <fc/io/json.hpp>
 #include <fc/filesystem.hpp>
@@ -17,6 +16,19 @@
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/path.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <thread>
+
+#include "block_log_reader.hpp"
+#include "compact_dump.hpp"
+#include "fork_graph.hpp"
+#include "fork_tree.hpp"
+#include "forkdb_reader.hpp"
+#include "snapshot_diff.hpp"
+
 using namespace eosio::chain;
 namespace bfs = boost::filesystem;
 namespace bpo = boost::program_options;
@@ -29,6 +41,12 @@ struct forkdb {
    {}
 
    void read_log();
+   void print_fork_tree();
+   bool verify();
+   bool check_log();
+   void compare_nodes();
+   void watch_snapshots();
+   std::ostream* open_output(std::ofstream& file);
    void set_program_options(options_description& cli);
    void initialize(const variables_map& options);
 
@@ -41,6 +59,15 @@ struct forkdb {
    bool                             info;
    uint32_t                         pack_header_from;
    uint32_t                         pack_header_interval;
+   bool                             compact;
+   bool                             fork_tree_only;
+   string                           tree_format;
+   bool                             verify_only;
+   uint32_t                         threads;
+   bfs::path                        log_dir;
+   std::vector<bfs::path>           compare_files;
+   bfs::path                        watch_dir;
+   uint32_t                         watch_interval_ms;
 };
 
 template <typename T>
@@ -60,17 +87,22 @@ void print_var(std::ostream* out, const string& name, const T &v){
 
 
 void forkdb::read_log() {
-   fork_database fork_db(blocks_dir);
-   const auto end = fork_db.head();
-   EOS_ASSERT( end, block_log_exception, "No blocks found in forkdb." );
-
-   block_state_ptr first = end;
-   while(fork_db.get_block(first->header.previous) != block_state_ptr()){
-      first = fork_db.get_block(first->header.previous);
-   }
+   forkdb_reader reader(blocks_dir);
+   EOS_ASSERT( reader.head >= 0, block_log_exception, "No blocks found in forkdb." );
+
+   // current chain from the root up to the head, following previous links through the id index
+   std::vector<uint32_t> chain;
+   for( int64_t i = reader.head; i >= 0 && chain.size() < reader.entries.size(); i = reader.find( reader.entries[i].previous ) )
+      chain.push_back( i );
+   std::reverse( chain.begin(), chain.end() );
+   const auto& first = reader.entries[chain.front()];
+   const auto& end = reader.entries[chain.back()];
+   auto get_block_in_current_chain_by_num = [&]( uint32_t n ) {
+      return n >= first.block_num && n <= end.block_num ? reader.decode( chain[n - first.block_num] ) : block_state_ptr();
+   };
 
-   std::cout << "forkdb.bat contains " << end->block_num - first->block_num + 1 << " block(s): [ "
-             << first->block_num << " - " << end->block_num << " ]" << std::endl;
+   std::cout << "forkdb.bat contains " << end.block_num - first.block_num + 1 << " block(s): [ "
+             << first.block_num << " - " << end.block_num << " ]" << std::endl;
    if(info) return;
 
    std::ofstream output_blocks;
@@ -89,7 +121,7 @@ void forkdb::read_log() {
 
    if (as_json_array)
       *out << "[";
-   uint32_t block_num = (first_block < first->block_num) ? first->block_num : first_block;
+   uint32_t block_num = (first_block < first.block_num) ? first.block_num : first_block;
    block_state_ptr next;
    fc::variant pretty_output;
    const fc::microseconds deadline = fc::seconds(10);
@@ -113,7 +145,7 @@ void forkdb::read_log() {
          *out << fc::json::to_pretty_string(v) << "\n";
 
       if(true){
-         auto n = *next;
+         const auto& n = *next;
          print_packed_data( out, "header",n.header);
          print_hex(out,"pending_schedule_hash",n.pending_schedule_hash.data(),n.pending_schedule_hash.data_size());
          print_var(out,"pending_schedule",n.pending_schedule);
@@ -130,9 +162,25 @@ void forkdb::read_log() {
    };
 
 
-   if( pack_header_from == 0 ){
+   if( compact ){
+      bool contains_obj = false;
+      compact_dumper dumper( [&]( fc::variant&& v ) {
+         if (as_json_array && contains_obj)
+            *out << ",";
+         if (no_pretty_print)
+            fc::json::to_stream(*out, v, fc::json::stringify_large_ints_and_doubles);
+         else
+            *out << fc::json::to_pretty_string(v) << "\n";
+         contains_obj = true;
+      });
+      block_state state;   // decode target reused from block to block
+      for( ; block_num <= last_block && block_num <= end.block_num; ++block_num ) {
+         reader.decode( chain[block_num - first.block_num], state );
+         dumper.dump( state );
+      }
+   } else if( pack_header_from == 0 ){
       bool contains_obj = false;
-      while((block_num <= last_block) && (next = fork_db.get_block_in_current_chain_by_num( block_num ))) {
+      while((block_num <= last_block) && (next = get_block_in_current_chain_by_num( block_num ))) {
          if (as_json_array && contains_obj)
             *out << ",";
          print_block(next);
@@ -142,7 +190,7 @@ void forkdb::read_log() {
    } else {
       block_num = pack_header_from;
       std::vector<signed_block_header> headers;
-      while((block_num <= pack_header_from + pack_header_interval) && (next = fork_db.get_block_in_current_chain_by_num(  block_num ))) {
+      while((block_num <= pack_header_from + pack_header_interval) && (next = get_block_in_current_chain_by_num( block_num ))) {
          headers.push_back(next->header);
          ++block_num;
       }
@@ -154,11 +202,355 @@ void forkdb::read_log() {
       *out << "]";
 }
 
+void forkdb::print_fork_tree() {
+   forkdb_reader reader(blocks_dir);
+   fork_tree tree(reader);
+
+   std::ofstream output_blocks;
+   std::ostream* out = open_output(output_blocks);
+
+   if (tree_format == "json")
+      tree.print_json(*out, !no_pretty_print);
+   else if (tree_format == "dot")
+      tree.print_dot(*out);
+   else
+      tree.print_text(*out);
+}
+
+std::ostream* forkdb::open_output(std::ofstream& file) {
+   if (output_file.empty())
+      return &std::cout;
+   file.open(output_file.generic_string().c_str());
+   EOS_ASSERT( !file.fail(), fc::invalid_arg_exception, "Unable to open file '${f}'", ("f", output_file.string()) );
+   return &file;
+}
+
+/**
+ *  Checks one block_state on its own and against its parent, if the parent is in the forkdb:
+ *  the producer signature over the recomputed sig_digest must recover the producer's key from the active
+ *  schedule, and blockroot_merkle must be the parent's merkle with the parent id appended.
+ *  Returns an empty string when the block passes.
+ */
+static string verify_block_state(const block_state& s, const block_state* parent) {
+   if (s.header.new_producers && s.pending_schedule_hash != digest_type::hash(*s.header.new_producers))
+      return "pending_schedule_hash does not match the new producers of the header";
+
+   const auto header_bmroot = digest_type::hash( std::make_pair( s.header.digest(), s.blockroot_merkle.get_root() ) );
+   const auto digest = digest_type::hash( std::make_pair( header_bmroot, s.pending_schedule_hash ) );
+   public_key_type signer;
+   try {
+      signer = public_key_type( s.header.producer_signature, digest, true );
+   } catch( const fc::exception& e ) {
+      return "unable to recover the producer key: " + e.to_string();
+   }
+   if (signer != s.block_signing_key)
+      return "signature does not match block_signing_key";
+   auto itr = std::find_if( s.active_schedule.producers.begin(), s.active_schedule.producers.end(),
+                            [&]( const producer_key& p ) { return p.producer_name == s.header.producer; } );
+   if (itr == s.active_schedule.producers.end())
+      return "producer " + s.header.producer.to_string() + " is not in the active schedule";
+   if (itr->block_signing_key != signer)
+      return "signing key is not the key of " + s.header.producer.to_string() + " in the active schedule";
+
+   if (parent) {
+      auto merkle = parent->blockroot_merkle;
+      merkle.append( parent->id );
+      if (merkle._node_count != s.blockroot_merkle._node_count || merkle.get_root() != s.blockroot_merkle.get_root())
+         return "blockroot_merkle does not continue the parent's merkle";
+   }
+   return string();
+}
+
+bool forkdb::verify() {
+   forkdb_reader reader(blocks_dir);
+   const auto& entries = reader.entries;
+   std::vector<string> errors( entries.size() );
+   std::atomic<size_t> next_chunk{0};
+   const size_t chunk = 64;
+   const auto start = fc::time_point::now();
+
+   // records are mostly written parent first, so each worker takes runs of consecutive entries and keeps the
+   // previous decode around to serve as the next block's parent
+   auto work = [&]() {
+      block_state states[2];
+      int64_t decoded[2] = { -1, -1 };
+      uint32_t cur = 0;
+      for( size_t c = next_chunk++; c * chunk < entries.size(); c = next_chunk++ ) {
+         for( size_t i = c * chunk; i < std::min( entries.size(), (c + 1) * chunk ); ++i ) {
+            try {
+               const int64_t p = reader.find( entries[i].previous );
+               const block_state* parent = nullptr;
+               if( p >= 0 ) {
+                  if( decoded[cur ^ 1] != p ) {
+                     reader.decode( p, states[cur ^ 1] );
+                     decoded[cur ^ 1] = p;
+                  }
+                  parent = &states[cur ^ 1];
+               }
+               reader.decode( i, states[cur] );
+               decoded[cur] = i;
+               errors[i] = verify_block_state( states[cur], parent );
+               cur ^= 1;
+            } catch( const fc::exception& e ) {
+               errors[i] = e.to_string();
+            }
+         }
+      }
+   };
+   std::vector<std::thread> workers;
+   for( uint32_t t = 1; t < threads; ++t )
+      workers.emplace_back( work );
+   work();
+   for( auto& w : workers )
+      w.join();
+
+   std::ofstream output_blocks;
+   std::ostream* out = open_output(output_blocks);
+   size_t failed = 0;
+   for( size_t i = 0; i < entries.size(); ++i ) {
+      if( errors[i].empty() )
+         continue;
+      ++failed;
+      *out << entries[i].block_num << " " << entries[i].id.str() << ": " << errors[i] << "\n";
+   }
+   const auto elapsed = fc::time_point::now() - start;
+   *out << "verified " << entries.size() << " block state(s), " << failed << " failed, in "
+        << elapsed.count() / 1000 << " ms using " << threads << " thread(s)" << std::endl;
+   return failed == 0;
+}
+
+/**
+ *  Does forkdb.dat continue blocks.log?  The forkdb root, the block whose previous is not in the forkdb,
+ *  must sit right after the log head and link to its id, or overlap it with identical ids, and the log
+ *  must not run past the forkdb's last irreversible block.  Of the log only the index tail and a header or
+ *  two are read; of the forkdb only the record index is built and only the head block state is decoded.
+ */
+bool forkdb::check_log() {
+   block_log_reader log(log_dir);
+   forkdb_reader reader(blocks_dir);
+   EOS_ASSERT( reader.head >= 0, block_log_exception, "No blocks found in forkdb." );
+   const auto& entries = reader.entries;
+
+   std::ofstream output_blocks;
+   std::ostream* out = open_output(output_blocks);
+   bool ok = true;
+   auto fail = [&]( const string& msg ) {
+      *out << "FAIL: " << msg << "\n";
+      ok = false;
+   };
+
+   const uint32_t log_head_num = log.last_block_num();
+   const auto log_head = log.read_block_header( log_head_num );
+   const auto log_head_id = log_head.id();
+   *out << "block log: [ " << log.first_block_num() << " - " << log_head_num << " ] head " << log_head_id.str() << "\n";
+
+   // the root of the head chain; other parentless entries are orphans
+   int64_t root = reader.head;
+   for( size_t steps = 0; steps < entries.size(); ++steps ) {
+      const int64_t p = reader.find( entries[root].previous );
+      if( p < 0 )
+         break;
+      root = p;
+   }
+   uint32_t orphans = 0;
+   for( const auto& e : entries )
+      if( reader.find( e.previous ) < 0 && e.id != entries[root].id )
+         ++orphans;
+   const auto& r = entries[root];
+   const auto& h = entries[reader.head];
+   *out << "forkdb: [ " << r.block_num << " - " << h.block_num << " ] root " << r.id.str() << " head " << h.id.str()
+        << ", " << entries.size() << " block state(s)\n";
+   if( orphans > 0 )
+      fail( std::to_string( orphans ) + " block state(s) not connected to the head chain root" );
+
+   if( r.block_num == log_head_num + 1 ) {
+      if( r.previous == log_head_id )
+         *out << "seam: forkdb root " << r.block_num << " links to log head " << log_head_num << "\n";
+      else
+         fail( "forkdb root " + std::to_string( r.block_num ) + " previous " + r.previous.str() + " is not the log head id" );
+   } else if( r.block_num > log_head_num + 1 ) {
+      fail( "gap of " + std::to_string( r.block_num - log_head_num - 1 ) + " block(s) between log head " +
+            std::to_string( log_head_num ) + " and forkdb root " + std::to_string( r.block_num ) );
+   } else {
+      // overlap: the overlapping head chain blocks must be the ones in the log
+      *out << "overlap: blocks [ " << r.block_num << " - " << std::min( log_head_num, h.block_num ) << " ] are in both\n";
+      if( r.block_num >= log.first_block_num() && log.read_block_header( r.block_num ).id() != r.id )
+         fail( "forkdb root " + std::to_string( r.block_num ) + " differs from the log block with the same number" );
+      for( int64_t i = reader.head; i >= 0; i = reader.find( entries[i].previous ) ) {
+         if( entries[i].block_num == log_head_num ) {
+            if( entries[i].id != log_head_id )
+               fail( "forkdb block " + std::to_string( log_head_num ) + " " + entries[i].id.str() + " is not the log head" );
+            break;
+         }
+         if( entries[i].block_num < log_head_num )
+            break;
+      }
+   }
+
+   const auto head_state = reader.decode( reader.head );
+   const uint32_t lib = std::max( head_state->dpos_irreversible_blocknum, head_state->bft_irreversible_blocknum );
+   *out << "forkdb head irreversible block: " << lib << "\n";
+   if( log_head_num > h.block_num )
+      fail( "log head " + std::to_string( log_head_num ) + " is past the forkdb head " + std::to_string( h.block_num ) );
+   else if( log_head_num > lib )
+      fail( "log head " + std::to_string( log_head_num ) + " is past the last irreversible block " + std::to_string( lib ) );
+   else if( log_head_num < lib )
+      *out << "irreversible blocks [ " << log_head_num + 1 << " - " << lib << " ] are not in the log yet (reversible_blocks)\n";
+
+   *out << (ok ? "OK" : "INCONSISTENT") << std::endl;
+   return ok;
+}
+
+void forkdb::compare_nodes() {
+   const uint32_t n = compare_files.size();
+   fork_graph graph( n );
+   std::vector<size_t> counts( n, 0 );
+   std::vector<string> errors( n );
+
+   // each file is indexed, merged into the graph and unmapped before the worker picks the next one
+   std::atomic<uint32_t> next_file{0};
+   auto work = [&]() {
+      for( uint32_t i = next_file++; i < n; i = next_file++ ) {
+         try {
+            forkdb_reader reader( compare_files[i] );
+            counts[i] = reader.entries.size();
+            graph.add( i, reader );
+         } catch( const fc::exception& e ) {
+            errors[i] = e.to_string();
+         } catch( const std::exception& e ) {
+            errors[i] = e.what();
+         }
+      }
+   };
+   std::vector<std::thread> workers;
+   for( uint32_t t = 1; t < std::min( threads, n ); ++t )
+      workers.emplace_back( work );
+   work();
+   for( auto& w : workers )
+      w.join();
+   graph.link();
+
+   std::ofstream output_blocks;
+   std::ostream* out = open_output(output_blocks);
+   const auto& blocks = graph.blocks;
+   *out << n << " node(s), " << blocks.size() << " distinct block(s), " << graph.segments.size() << " segment(s)\n";
+   if( graph.common_ancestor >= 0 )
+      *out << "highest common ancestor: " << blocks[graph.common_ancestor].block_num << " " << blocks[graph.common_ancestor].id.str() << "\n";
+   else
+      *out << "highest common ancestor: none, the heads do not share a block\n";
+
+   for( uint32_t i = 0; i < n; ++i ) {
+      *out << "node " << i << " " << compare_files[i].generic_string() << ": ";
+      if( !errors[i].empty() ) {
+         *out << "unreadable: " << errors[i] << "\n";
+         continue;
+      }
+      *out << counts[i] << " block(s)";
+      const int64_t h = graph.heads[i];
+      if( h >= 0 ) {
+         *out << ", head " << blocks[h].block_num << " " << blocks[h].id.str() << " segment " << graph.segment_of[h];
+         if( graph.common_ancestor >= 0 )
+            *out << ", " << blocks[h].block_num - blocks[graph.common_ancestor].block_num << " above the common ancestor";
+      }
+      *out << "\n";
+   }
+
+   for( size_t k = 0; k < graph.segments.size(); ++k ) {
+      const auto& seg = graph.segments[k];
+      *out << "segment " << k << ": [ " << blocks[seg.base].block_num << " - " << blocks[seg.tip].block_num << " ] length " << seg.length
+           << " tip " << blocks[seg.tip].id.str();
+      if( seg.fork_point >= 0 )
+         *out << " from " << blocks[seg.fork_point].block_num << " (segment " << graph.segment_of[seg.fork_point] << ")";
+      *out << ", held by";
+      for( uint32_t i = 0; i < n; ++i )
+         if( graph.holds( seg.tip, i ) )
+            *out << " " << i;
+      *out << ", heads";
+      for( uint32_t i = 0; i < n; ++i )
+         if( graph.heads[i] >= 0 && graph.segment_of[graph.heads[i]] == int64_t(k) )
+            *out << " " << i;
+      *out << "\n";
+   }
+   out->flush();
+}
+
+/**
+ *  Polls a directory for forkdb snapshot files and prints how each one differs from the previous one.
+ *  A file is only read once its size stayed the same over two polls, so a copy in progress is skipped;
+ *  files are taken in modification time order.  Only the record index of the last snapshot is kept.
+ */
+void forkdb::watch_snapshots() {
+   std::ofstream output_blocks;
+   std::ostream* out = open_output(output_blocks);
+   auto emit = [&]( fc::variant&& v ) {
+      fc::json::to_stream(*out, v, fc::json::stringify_large_ints_and_doubles);
+      *out << "\n";
+   };
+
+   // a file is identified by its name, size and modification time, so a snapshot rewritten under the same
+   // name is picked up again; it is read once the pair did not change between two polls
+   typedef std::pair<uintmax_t, std::time_t> file_version;
+   std::map<bfs::path, file_version> pending;   // candidate -> version seen at the previous poll
+   std::map<bfs::path, file_version> done;      // file -> version already reported
+   optional<forkdb_snapshot> prev;
+   for(;;) {
+      std::vector<std::pair<std::time_t, bfs::path>> ready;
+      // files can vanish or be replaced between listing and stat, so failing entries are skipped until the next poll
+      boost::system::error_code ec;
+      bfs::directory_iterator itr( watch_dir, ec ), end;
+      for( ; !ec && itr != end; itr.increment( ec ) ) {
+         const auto& path = itr->path();
+         boost::system::error_code fec;
+         if( !bfs::is_regular_file( path, fec ) )
+            continue;
+         const auto file_size = bfs::file_size( path, fec );
+         if( fec )
+            continue;
+         const auto write_time = bfs::last_write_time( path, fec );
+         if( fec )
+            continue;
+         const file_version version( file_size, write_time );
+         auto d = done.find( path );
+         if( d != done.end() && d->second == version )
+            continue;
+         auto p = pending.find( path );
+         if( p != pending.end() && p->second == version && version.first > 0 )
+            ready.emplace_back( version.second, path );
+         else
+            pending[path] = version;
+      }
+      std::sort( ready.begin(), ready.end() );
+
+      for( const auto& r : ready ) {
+         done[r.second] = pending[r.second];
+         pending.erase( r.second );
+         try {
+            forkdb_reader reader( r.second );
+            forkdb_snapshot next( reader );
+            emit( fc::variant( fc::mutable_variant_object( "event", "snapshot" )( "file", r.second.filename().generic_string() )
+                               ( "time", fc::time_point_sec( r.first ) )( "blocks", next.blocks.size() )
+                               ( "head_block_num", next.head_num )( "head", next.head ) ) );
+            if( prev )
+               diff_snapshots( *prev, next, emit );
+            prev.emplace( std::move(next) );
+         } catch( const fc::exception& e ) {
+            emit( fc::variant( fc::mutable_variant_object( "event", "error" )( "file", r.second.filename().generic_string() )
+                               ( "error", e.to_string() ) ) );
+         } catch( const std::exception& e ) {
+            emit( fc::variant( fc::mutable_variant_object( "event", "error" )( "file", r.second.filename().generic_string() )
+                               ( "error", e.what() ) ) );
+         }
+      }
+      out->flush();
+      std::this_thread::sleep_for( std::chrono::milliseconds( watch_interval_ms ) );
+   }
+}
+
 void forkdb::set_program_options(options_description& cli)
 {
    cli.add_options()
          ("blocks-dir,d", bpo::value<bfs::path>()->default_value("forkdb.dat"),
-          "the forkdb file path (absolute path or relative to the current directory)")
+          "the forkdb file, or the directory containing forkdb.dat (absolute path or relative to the current directory). It is only read, never modified.")
          ("output-file,o", bpo::value<bfs::path>(),
           "the file to write output to (absolute or relative path).  If not specified then output is to stdout.")
          ("first,f", bpo::value<uint32_t>(&first_block)->default_value(1),
@@ -175,13 +567,34 @@ void forkdb::set_program_options(options_description& cli)
           "Print packed headers.")
          ("pack-header-interval", bpo::value<uint32_t>(&pack_header_interval)->default_value(10),
           "Print packed headers.")
+         ("compact", bpo::bool_switch(&compact)->default_value(false),
+          "Print the current chain as deltas: producer schedules once with a reference id, blockroot_merkle changes, "
+          "and only the block state fields that differ from the previous block.")
+         ("fork-tree", bpo::bool_switch(&fork_tree_only)->default_value(false),
+          "Print every branch of the fork tree: its blocks, length, producers and where it diverges from the head chain.")
+         ("tree-format", bpo::value<string>(&tree_format)->default_value("text"),
+          "Output format of --fork-tree: text, json or dot (Graphviz).")
+         ("verify", bpo::bool_switch(&verify_only)->default_value(false),
+          "Verify every block state on every branch: producer signature over the recomputed sig_digest against the active schedule, "
+          "and blockroot_merkle continuity with the parent.")
+         ("check-log", bpo::value<bfs::path>(),
+          "Check that the forkdb continues the block log in this blocks directory: root links to the log head, no gap or "
+          "conflicting overlap, log head not past the last irreversible block.")
+         ("compare", bpo::value<std::vector<bfs::path>>(&compare_files)->composing()->multitoken(),
+          "Compare the forkdb files of several nodes: merged fork graph, the nodes holding each segment, "
+          "the highest common ancestor of all heads and where each node's head sits.")
+         ("watch", bpo::value<bfs::path>(),
+          "Watch this directory for new forkdb snapshot files and print one line per event: snapshot, blocks added, "
+          "blocks pruned, head switch. Runs until interrupted.")
+         ("watch-interval", bpo::value<uint32_t>(&watch_interval_ms)->default_value(1000),
+          "Polling interval of --watch in milliseconds.")
+         ("threads,t", bpo::value<uint32_t>(&threads)->default_value(std::max(1u, std::thread::hardware_concurrency())),
+          "Number of worker threads for --verify and --compare.")
          ("help,h", "Print this help message and exit.")
          ;
 
 }
 
-fc::path tmp_dir;
-
 void forkdb::initialize(const variables_map& options) {
    try {
       auto bld = options.at( "blocks-dir" ).as<bfs::path>();
@@ -190,16 +603,26 @@ void forkdb::initialize(const variables_map& options) {
       else
          blocks_dir = bld;
 
-      tmp_dir = blocks_dir / "tmp";
-      if (!fc::is_directory(tmp_dir))
-         fc::create_directories(tmp_dir);
-      auto tmp_file = tmp_dir / config::forkdb_filename;
+      EOS_ASSERT( threads > 0, fc::invalid_arg_exception, "--threads must be positive" );
+      EOS_ASSERT( tree_format == "text" || tree_format == "json" || tree_format == "dot", fc::invalid_arg_exception,
+                  "--tree-format must be text, json or dot" );
 
-      if (exists(tmp_file))
-         remove(tmp_file);
-      copy_file(blocks_dir/config::forkdb_filename, tmp_dir/config::forkdb_filename);
+      if (options.count( "check-log" )) {
+         bld = options.at( "check-log" ).as<bfs::path>();
+         if( bld.is_relative())
+            log_dir = bfs::current_path() / bld;
+         else
+            log_dir = bld;
+      }
 
-      blocks_dir = tmp_dir;
+      if (options.count( "watch" )) {
+         bld = options.at( "watch" ).as<bfs::path>();
+         if( bld.is_relative())
+            watch_dir = bfs::current_path() / bld;
+         else
+            watch_dir = bld;
+         EOS_ASSERT( bfs::is_directory( watch_dir ), fc::invalid_arg_exception, "${d} is not a directory", ("d", watch_dir.generic_string()) );
+      }
 
       if (options.count( "output-file" )) {
          bld = options.at( "output-file" ).as<bfs::path>();
@@ -228,7 +651,18 @@ int main(int argc, char** argv)
          return 0;
       }
       fdb.initialize(vmap);
-      fdb.read_log();
+      if (fdb.verify_only)
+         return fdb.verify() ? 0 : 1;
+      else if (!fdb.log_dir.empty())
+         return fdb.check_log() ? 0 : 1;
+      else if (!fdb.compare_files.empty())
+         fdb.compare_nodes();
+      else if (!fdb.watch_dir.empty())
+         fdb.watch_snapshots();
+      else if (fdb.fork_tree_only)
+         fdb.print_fork_tree();
+      else
+         fdb.read_log();
    } catch( const fc::exception& e ) {
       elog( "${e}", ("e", e.to_detail_string()));
       return -1;
@@ -243,8 +677,6 @@ int main(int argc, char** argv)
       return -1;
    }
 
-   fc::remove_all(tmp_dir);
-
    return 0;
 }
 
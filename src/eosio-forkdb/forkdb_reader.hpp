@@ -0,0 +1,231 @@
+#pragma once
+
+#include <eosio/chain/block_state.hpp>
+#include <eosio/chain/config.hpp>
+#include <eosio/chain/exceptions.hpp>
+
+#include <fc/io/raw.hpp>
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/path.hpp>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <unordered_map>
+
+namespace eosio {
+    namespace chain {
+
+       /// position and links of one block_state record inside forkdb.dat
+       struct forkdb_entry {
+          block_id_type   id;
+          block_id_type   previous;
+          uint32_t        block_num = 0;
+          account_name    producer;
+          uint64_t        offset = 0;
+          uint64_t        size = 0;
+       };
+
+       struct block_id_hash {
+          size_t operator()( const block_id_type& id )const { return id._hash[3]; }
+       };
+
+       /**
+        *  Read-only view of a forkdb.dat file.
+        *
+        *  fork_database removes forkdb.dat when it loads it and writes it back when it closes, so it cannot
+        *  be pointed at a node's data directory.  This reader maps the file in place instead, never writes
+        *  to it, and keeps only an id -> record index; block_states are decoded on demand.
+        *
+        *  forkdb.dat layout: unsigned_int count, count packed block_states, then the head block id.
+        */
+       struct forkdb_reader {
+          /// `path` is either forkdb.dat itself or the directory holding it
+          explicit forkdb_reader( const boost::filesystem::path& path ) {
+             file = boost::filesystem::is_directory( path ) ? path / config::forkdb_filename : path;
+             fd = ::open( file.generic_string().c_str(), O_RDONLY );
+             EOS_ASSERT( fd >= 0, fork_database_exception, "Unable to open ${f}", ("f", file.generic_string()) );
+             struct stat st;
+             ::fstat( fd, &st );
+             size = st.st_size;
+             EOS_ASSERT( size > 0, fork_database_exception, "${f} is empty", ("f", file.generic_string()) );
+             void* p = ::mmap( nullptr, size, PROT_READ, MAP_SHARED, fd, 0 );
+             EOS_ASSERT( p != MAP_FAILED, fork_database_exception, "Unable to map ${f}", ("f", file.generic_string()) );
+             data = static_cast<const char*>( p );
+             ::madvise( p, size, MADV_SEQUENTIAL );
+             try {
+                build_index();
+             } catch( ... ) {
+                ::munmap( p, size );
+                ::close( fd );
+                throw;
+             }
+          }
+
+          ~forkdb_reader() {
+             if( data )
+                ::munmap( const_cast<char*>(data), size );
+             if( fd >= 0 )
+                ::close( fd );
+          }
+
+          forkdb_reader( const forkdb_reader& ) = delete;
+          forkdb_reader& operator=( const forkdb_reader& ) = delete;
+
+          /// index into entries, or -1
+          int64_t find( const block_id_type& id )const {
+             auto itr = by_id.find( id );
+             return itr == by_id.end() ? -1 : int64_t(itr->second);
+          }
+
+          block_state_ptr decode( size_t i )const {
+             auto s = std::make_shared<block_state>();
+             decode( i, *s );
+             return s;
+          }
+
+          void decode( size_t i, block_state& s )const {
+             fc::datastream<const char*> ds( data + entries[i].offset, entries[i].size );
+             s.header.new_producers.reset();   // fc leaves an absent optional or shared_ptr untouched on unpack
+             s.block.reset();
+             fc::raw::unpack( ds, s );
+          }
+
+          boost::filesystem::path                                    file;
+          vector<forkdb_entry>                                       entries;
+          std::unordered_map<block_id_type, uint32_t, block_id_hash> by_id;
+          block_id_type                                              head_id;
+          int64_t                                                    head = -1;   ///< index of the head entry
+
+       private:
+          /// scratch for skipping a packed signed_block, reused so that skipping allocates nothing per transaction
+          struct block_skipper {
+             signed_block_header          header;
+             transaction_receipt_header   receipt;
+             vector<signature_type>       signatures;
+             extensions_type              extensions;
+
+             static void skip( fc::datastream<const char*>& ds, size_t n ) {
+                EOS_ASSERT( ds.remaining() >= n, fork_database_exception, "forkdb.dat record runs past the end of the file" );
+                ds.skip( n );
+             }
+
+             static void skip_bytes( fc::datastream<const char*>& ds ) {
+                unsigned_int n;
+                fc::raw::unpack( ds, n );
+                skip( ds, n.value );
+             }
+
+             /// advances `ds` past a signed_block, reading the header and the lengths but none of the transaction bodies
+             void skip_block( fc::datastream<const char*>& ds ) {
+                fc::raw::unpack( ds, header );
+                unsigned_int trxs;
+                fc::raw::unpack( ds, trxs );
+                for( uint32_t i = 0; i < trxs.value; ++i ) {
+                   fc::raw::unpack( ds, receipt );
+                   unsigned_int which;   // static_variant<transaction_id_type, packed_transaction>
+                   fc::raw::unpack( ds, which );
+                   if( which.value == 0 ) {
+                      skip( ds, sizeof(transaction_id_type) );
+                   } else {
+                      fc::raw::unpack( ds, signatures );
+                      skip( ds, 1 );     // compression
+                      skip_bytes( ds );  // packed_context_free_data
+                      skip_bytes( ds );  // packed_trx
+                   }
+                }
+                fc::raw::unpack( ds, extensions );
+             }
+          };
+
+          /**
+           *  One pass over the records to learn their extent and links.  Only the block_header_state prefix of
+           *  each record is unpacked and the block behind it is skipped by its lengths.  The fields after the
+           *  block are taken to have the size they have in the first record, which is decoded in full; if the
+           *  pass does not then end on the head id the index is rebuilt by decoding every record.
+           */
+          void build_index() {
+             try {
+                if( build_index( true ) )
+                   return;
+             } catch( const fc::exception& ) {
+             } catch( const std::exception& ) {
+             }
+             entries.clear();
+             by_id.clear();
+             head = -1;
+             build_index( false );
+          }
+
+          bool build_index( bool light ) {
+             fc::datastream<const char*> ds( data, size );
+             unsigned_int count;
+             fc::raw::unpack( ds, count );
+             entries.reserve( count.value );
+             by_id.reserve( count.value );
+             block_state s;
+             block_skipper skipper;
+             // whether fc packs a presence flag ahead of a shared_ptr
+             const bool ptr_flag = fc::raw::pack_size( std::make_shared<uint8_t>( 0 ) ) > 1;
+             uint64_t trailing = 0;
+             for( uint32_t i = 0; i < count.value; ++i ) {
+                forkdb_entry e;
+                e.offset = ds.pos() - data;
+                s.header.new_producers.reset();
+                if( light && i > 0 ) {
+                   fc::raw::unpack( ds, static_cast<block_header_state&>( s ) );
+                   bool has_block = true;
+                   if( ptr_flag )
+                      fc::raw::unpack( ds, has_block );
+                   if( has_block )
+                      skipper.skip_block( ds );
+                   block_skipper::skip( ds, trailing );
+                } else {
+                   s.block.reset();
+                   fc::raw::unpack( ds, s );
+                   if( light ) {
+                      fc::datastream<const char*> probe( data + e.offset, size - e.offset );
+                      block_header_state h;
+                      fc::raw::unpack( probe, h );
+                      bool has_block = true;
+                      if( ptr_flag )
+                         fc::raw::unpack( probe, has_block );
+                      if( has_block )
+                         skipper.skip_block( probe );
+                      trailing = ds.pos() - probe.pos();
+                   }
+                }
+                e.size      = (ds.pos() - data) - e.offset;
+                e.id        = s.id;
+                e.previous  = s.header.previous;
+                e.block_num = s.block_num;
+                e.producer  = s.header.producer;
+                by_id.emplace( e.id, entries.size() );
+                entries.emplace_back( std::move(e) );
+             }
+             if( light && ds.remaining() != 0 && ds.remaining() != sizeof(block_id_type) )
+                return false;
+             if( ds.remaining() >= sizeof(block_id_type) ) {
+                fc::raw::unpack( ds, head_id );
+                head = find( head_id );
+             }
+             if( head < 0 ) {   // no (known) head id recorded: fall back to the highest block
+                for( size_t i = 0; i < entries.size(); ++i )
+                   if( head < 0 || entries[i].block_num > entries[head].block_num )
+                      head = i;
+                if( head >= 0 )
+                   head_id = entries[head].id;
+             }
+             return true;
+          }
+
+          int           fd = -1;
+          const char*   data = nullptr;
+          uint64_t      size = 0;
+       };
+
+    }
+} /// namespace eosio::chain
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <fc/variant_object.hpp>
+
+#include <functional>
+#include <unordered_set>
+
+#include "forkdb_reader.hpp"
+
+namespace eosio {
+    namespace chain {
+
+       /// what is kept of a forkdb snapshot between two polls: its record index, without the mapping
+       struct forkdb_snapshot {
+          explicit forkdb_snapshot( const forkdb_reader& reader ) {
+             blocks.reserve( reader.entries.size() );
+             for( const auto& e : reader.entries )
+                blocks.emplace( e.id, e );
+             if( reader.head >= 0 ) {
+                head = reader.head_id;
+                head_num = reader.entries[reader.head].block_num;
+             }
+          }
+
+          const forkdb_entry* find( const block_id_type& id )const {
+             auto itr = blocks.find( id );
+             return itr == blocks.end() ? nullptr : &itr->second;
+          }
+
+          /// true if `ancestor` is on the chain leading to `id` within this snapshot
+          bool descends_from( const block_id_type& id, const block_id_type& ancestor, uint32_t ancestor_num )const {
+             for( auto e = find( id ); e && e->block_num >= ancestor_num; e = find( e->previous ) )
+                if( e->id == ancestor )
+                   return true;
+             return false;
+          }
+
+          std::unordered_map<block_id_type, forkdb_entry, block_id_hash>   blocks;
+          block_id_type                                                     head;
+          uint32_t                                                          head_num = 0;
+       };
+
+       /**
+        *  Emits the change from `prev` to `next` as compact event records: added and pruned blocks as counts and
+        *  block number ranges, added blocks off the new head chain one by one, and a head_switch record when the
+        *  head moved, flagged as a reorg when the new head does not descend from the old one.
+        */
+       inline void diff_snapshots( const forkdb_snapshot& prev, const forkdb_snapshot& next,
+                                   const std::function<void( fc::variant&& )>& emit ) {
+          // head chain of the new snapshot, to tell forks from regular growth
+          std::unordered_set<block_id_type, block_id_hash> head_chain;
+          for( auto e = next.find( next.head ); e && !head_chain.count( e->id ); e = next.find( e->previous ) )
+             head_chain.insert( e->id );
+
+          uint32_t added = 0, pruned = 0;
+          uint32_t added_min = UINT32_MAX, added_max = 0, pruned_min = UINT32_MAX, pruned_max = 0;
+          vector<fc::variant> forks;
+          for( const auto& b : next.blocks ) {
+             if( prev.blocks.count( b.first ) )
+                continue;
+             ++added;
+             added_min = std::min( added_min, b.second.block_num );
+             added_max = std::max( added_max, b.second.block_num );
+             if( !head_chain.count( b.first ) )
+                forks.emplace_back( fc::mutable_variant_object( "block_num", b.second.block_num )( "id", b.first )
+                                                             ( "producer", b.second.producer ) );
+          }
+          for( const auto& b : prev.blocks ) {
+             if( next.blocks.count( b.first ) )
+                continue;
+             ++pruned;
+             pruned_min = std::min( pruned_min, b.second.block_num );
+             pruned_max = std::max( pruned_max, b.second.block_num );
+          }
+
+          if( added > 0 ) {
+             fc::mutable_variant_object o( "event", "added" );
+             o( "count", added )( "first", added_min )( "last", added_max );
+             if( !forks.empty() )
+                o( "off_head_chain", forks );
+             emit( fc::variant( std::move(o) ) );
+          }
+          if( pruned > 0 )
+             emit( fc::variant( fc::mutable_variant_object( "event", "pruned" )( "count", pruned )
+                                                           ( "first", pruned_min )( "last", pruned_max ) ) );
+          if( next.head != prev.head ) {
+             const bool extends = next.descends_from( next.head, prev.head, prev.head_num );
+             emit( fc::variant( fc::mutable_variant_object( "event", "head_switch" )
+                                ( "from_block_num", prev.head_num )( "from", prev.head )
+                                ( "to_block_num", next.head_num )( "to", next.head )( "reorg", !extends ) ) );
+          }
+       }
+
+    }
+} /// namespace eosio::chain
@@ -0,0 +1,255 @@
+#pragma once
+
+#include <array>
+#include <algorithm>
+
+#include <boost/uuid/string_generator.hpp>
+#include <boost/uuid/uuid_io.hpp>
+
+#include "pbft_database.hpp"
+
+namespace eosio {
+    namespace chain {
+
+       /// message uuid as its 16 binary bytes; only the canonical text form round-trips, so anything else is rejected
+       struct uuid128 {
+          static uuid128 from_string( const string& s ) {
+             uuid128 r;
+             try {
+                const auto u = boost::uuids::string_generator()( s );
+                std::copy( u.begin(), u.end(), r.bytes.begin() );
+             } catch( const std::exception& ) {
+             }
+             EOS_ASSERT( r.to_string() == s, chain_exception, "message uuid '${u}' is not a canonical uuid, it cannot be stored flat", ("u", s) );
+             return r;
+          }
+
+          string to_string()const {
+             boost::uuids::uuid u;
+             std::copy( bytes.begin(), bytes.end(), u.begin() );
+             return boost::uuids::to_string( u );
+          }
+
+          friend bool operator==( const uuid128& a, const uuid128& b ) { return a.bytes == b.bytes; }
+          friend bool operator<( const uuid128& a, const uuid128& b )  { return a.bytes < b.bytes; }
+
+          std::array<uint8_t, 16> bytes{};
+       };
+
+       /// prepares or commits as struct-of-arrays: one column per field
+       struct pbft_message_columns {
+          template<typename Message>
+          void push( const Message& m ) {
+             uuid.push_back( uuid128::from_string( m.uuid ) );
+             view.push_back( m.view );
+             block_num.push_back( m.block_num );
+             block_id.push_back( m.block_id );
+             public_key.push_back( m.public_key );
+             chain_id.push_back( m.chain_id );
+             signature.push_back( m.producer_signature );
+             timestamp.push_back( m.timestamp );
+          }
+
+          /// reorders in place so that row k is the old row order[k], then keeps the first `keep` rows
+          void permute( const vector<uint32_t>& order, uint32_t keep ) {
+             vector<bool> placed;
+             permute( uuid, order, keep, placed );
+             permute( view, order, keep, placed );
+             permute( block_num, order, keep, placed );
+             permute( block_id, order, keep, placed );
+             permute( public_key, order, keep, placed );
+             permute( chain_id, order, keep, placed );
+             permute( signature, order, keep, placed );
+             permute( timestamp, order, keep, placed );
+          }
+
+          template<typename Message>
+          Message get( uint32_t i )const {
+             Message m;
+             m.uuid               = uuid[i].to_string();
+             m.view               = view[i];
+             m.block_num          = block_num[i];
+             m.block_id           = block_id[i];
+             m.public_key         = public_key[i];
+             m.chain_id           = chain_id[i];
+             m.producer_signature = signature[i];
+             m.timestamp          = timestamp[i];
+             return m;
+          }
+
+          size_t size()const { return uuid.size(); }
+
+          vector<uuid128>           uuid;
+          vector<uint32_t>          view;
+          vector<block_num_type>    block_num;
+          vector<block_id_type>     block_id;
+          vector<public_key_type>   public_key;
+          vector<fc::sha256>        chain_id;
+          vector<signature_type>    signature;
+          vector<time_point>        timestamp;
+
+       private:
+          /// follows each cycle of the permutation, so a column needs one spare element rather than a second copy
+          template<typename T>
+          static void permute( vector<T>& v, const vector<uint32_t>& order, uint32_t keep, vector<bool>& placed ) {
+             placed.assign( order.size(), false );
+             for( uint32_t i = 0; i < order.size(); ++i ) {
+                if( placed[i] )
+                   continue;
+                T tmp = std::move( v[i] );
+                for( uint32_t j = i;; ) {
+                   placed[j] = true;
+                   const uint32_t k = order[j];
+                   if( k == i ) {
+                      v[j] = std::move( tmp );
+                      break;
+                   }
+                   v[j] = std::move( v[k] );
+                   j = k;
+                }
+             }
+             v.resize( keep );
+          }
+       };
+
+       /**
+        *  Read-only flat alternative to pbft_state_multi_index_type.
+        *
+        *  States live in one array sorted by block number, each holding [begin, end) ranges into the prepare
+        *  and commit columns, which are laid out in the same order.  The other orders of the multi_index are
+        *  permutation arrays over the states.  Filled through add() by pbftdb_reader::load(), then finish().
+        *  As in the block id index of the multi_index, only the first state of each block id is kept.
+        */
+       struct pbft_flat_store {
+          struct state {
+             block_id_type    block_id;
+             block_num_type   block_num = 0;
+             bool             should_prepared = false;
+             bool             should_committed = false;
+             uint32_t         prepares_begin = 0;
+             uint32_t         prepares_end = 0;
+             uint32_t         commits_begin = 0;
+             uint32_t         commits_end = 0;
+          };
+
+          void add( const pbft_state& s ) {
+             state f;
+             f.block_id         = s.block_id;
+             f.block_num        = s.block_num;
+             f.should_prepared  = s.should_prepared;
+             f.should_committed = s.should_committed;
+             f.prepares_begin   = prepares.size();
+             for( const auto& p : s.prepares )
+                prepares.push( p );
+             f.prepares_end     = prepares.size();
+             f.commits_begin    = commits.size();
+             for( const auto& c : s.commits )
+                commits.push( c );
+             f.commits_end      = commits.size();
+             states.push_back( f );
+          }
+
+          /// drops repeated block ids, sorts the states, lays the message columns out in the same order and builds the permutations
+          void finish() {
+             // first state of each block id in file order, as the hashed_unique block id index keeps on insert
+             vector<uint32_t> ids( states.size() );
+             for( uint32_t i = 0; i < ids.size(); ++i )
+                ids[i] = i;
+             std::stable_sort( ids.begin(), ids.end(), [&]( uint32_t a, uint32_t b ) { return states[a].block_id < states[b].block_id; } );
+             vector<bool> repeated( states.size(), false );
+             for( uint32_t i = 1; i < ids.size(); ++i )
+                repeated[ids[i]] = states[ids[i]].block_id == states[ids[i - 1]].block_id;
+             vector<uint32_t>().swap( ids );
+             vector<state> dropped;
+             uint32_t kept = 0;
+             for( uint32_t i = 0; i < states.size(); ++i ) {
+                if( repeated[i] )
+                   dropped.push_back( states[i] );
+                else
+                   states[kept++] = states[i];
+             }
+             states.resize( kept );
+
+             std::stable_sort( states.begin(), states.end(), []( const state& a, const state& b ) { return a.block_num < b.block_num; } );
+             // message order of the sorted states, then the messages of the dropped states, which are cut off
+             vector<uint32_t> p, c;
+             p.reserve( prepares.size() );
+             c.reserve( commits.size() );
+             for( auto& s : states ) {
+                const uint32_t pb = p.size(), cb = c.size();
+                for( uint32_t m = s.prepares_begin; m < s.prepares_end; ++m )
+                   p.push_back( m );
+                for( uint32_t m = s.commits_begin; m < s.commits_end; ++m )
+                   c.push_back( m );
+                s.prepares_begin = pb;
+                s.prepares_end   = p.size();
+                s.commits_begin  = cb;
+                s.commits_end    = c.size();
+             }
+             const uint32_t keep_prepares = p.size(), keep_commits = c.size();
+             for( const auto& s : dropped ) {
+                for( uint32_t m = s.prepares_begin; m < s.prepares_end; ++m )
+                   p.push_back( m );
+                for( uint32_t m = s.commits_begin; m < s.commits_end; ++m )
+                   c.push_back( m );
+             }
+             prepares.permute( p, keep_prepares );
+             commits.permute( c, keep_commits );
+
+             const auto n = states.size();
+             by_block_id.resize( n );
+             by_prepare_and_num.resize( n );
+             by_commit_and_num.resize( n );
+             for( uint32_t i = 0; i < n; ++i )
+                by_block_id[i] = by_prepare_and_num[i] = by_commit_and_num[i] = i;
+             std::sort( by_block_id.begin(), by_block_id.end(), [&]( uint32_t a, uint32_t b ) { return states[a].block_id < states[b].block_id; } );
+             // same orders as by_prepare_and_num / by_commit_and_num: flag, then block number, both descending
+             auto flag_then_num = [&]( bool state::*flag ) {
+                return [this, flag]( uint32_t a, uint32_t b ) {
+                   if( states[a].*flag != states[b].*flag )
+                      return states[a].*flag > states[b].*flag;
+                   return states[a].block_num > states[b].block_num;
+                };
+             };
+             std::sort( by_prepare_and_num.begin(), by_prepare_and_num.end(), flag_then_num( &state::should_prepared ) );
+             std::sort( by_commit_and_num.begin(), by_commit_and_num.end(), flag_then_num( &state::should_committed ) );
+          }
+
+          /// [begin, end) of the states with first <= block_num <= last
+          std::pair<uint32_t, uint32_t> range( uint32_t first, uint32_t last )const {
+             auto lo = std::lower_bound( states.begin(), states.end(), first, []( const state& s, uint32_t n ) { return s.block_num < n; } );
+             auto hi = std::upper_bound( lo, states.end(), last, []( uint32_t n, const state& s ) { return n < s.block_num; } );
+             return std::make_pair( uint32_t(lo - states.begin()), uint32_t(hi - states.begin()) );
+          }
+
+          /// index of the state of `id`, or -1
+          int64_t find( const block_id_type& id )const {
+             auto itr = std::lower_bound( by_block_id.begin(), by_block_id.end(), id, [&]( uint32_t i, const block_id_type& v ) { return states[i].block_id < v; } );
+             return itr != by_block_id.end() && states[*itr].block_id == id ? int64_t(*itr) : -1;
+          }
+
+          /// back to the nested form, for printing
+          pbft_state get( uint32_t i )const {
+             const auto& f = states[i];
+             pbft_state s;
+             s.block_id         = f.block_id;
+             s.block_num        = f.block_num;
+             s.should_prepared  = f.should_prepared;
+             s.should_committed = f.should_committed;
+             for( uint32_t m = f.prepares_begin; m < f.prepares_end; ++m )
+                s.prepares.push_back( prepares.get<pbft_prepare>( m ) );
+             for( uint32_t m = f.commits_begin; m < f.commits_end; ++m )
+                s.commits.push_back( commits.get<pbft_commit>( m ) );
+             return s;
+          }
+
+          vector<state>             states;
+          pbft_message_columns      prepares;
+          pbft_message_columns      commits;
+          vector<uint32_t>          by_block_id;
+          vector<uint32_t>          by_prepare_and_num;
+          vector<uint32_t>          by_commit_and_num;
+       };
+
+    }
+} /// namespace eosio::chain
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <algorithm>
+#include <map>
+#include <ostream>
+
+#include "pbft_database.hpp"
+
+namespace eosio {
+    namespace chain {
+
+       /// microsecond samples with percentiles and a power of two histogram
+       struct latency_samples {
+          void add( int64_t us ) { samples.push_back( us ); sorted = false; }
+
+          int64_t percentile( double p ) {
+             if( samples.empty() )
+                return 0;
+             sort();
+             const size_t i = std::min( samples.size() - 1, size_t( p / 100 * samples.size() ) );
+             return samples[i];
+          }
+
+          void print_row( std::ostream& out, const string& name ) {
+             out << name << ": n " << samples.size();
+             if( !samples.empty() ) {
+                sort();
+                out << ", min " << samples.front() / 1000.0 << " ms, p50 " << percentile( 50 ) / 1000.0 << " ms, p90 " << percentile( 90 ) / 1000.0
+                    << " ms, p99 " << percentile( 99 ) / 1000.0 << " ms, max " << samples.back() / 1000.0 << " ms";
+             }
+             out << "\n";
+          }
+
+          /// buckets [0, 1ms), [1, 2ms), [2, 4ms) ... with negative samples counted apart
+          void print_histogram( std::ostream& out, const string& name ) {
+             std::map<int, uint64_t> buckets;
+             uint64_t negative = 0;
+             for( auto s : samples ) {
+                if( s < 0 ) {
+                   ++negative;
+                   continue;
+                }
+                int b = 0;
+                for( int64_t ms = s / 1000; ms > 0; ms >>= 1 )
+                   ++b;
+                ++buckets[b];
+             }
+             out << name << " histogram:\n";
+             if( negative > 0 )
+                out << "  < 0 ms: " << negative << "\n";
+             for( const auto& b : buckets ) {
+                const int64_t lo = b.first == 0 ? 0 : int64_t(1) << (b.first - 1);
+                const int64_t hi = int64_t(1) << b.first;
+                out << "  [" << lo << ", " << hi << ") ms: " << b.second << " " << string( std::min<uint64_t>( 60, b.second * 60 / samples.size() + 1 ), '#' ) << "\n";
+             }
+          }
+
+          vector<int64_t>   samples;
+
+       private:
+          void sort() {
+             if( !sorted )
+                std::sort( samples.begin(), samples.end() );
+             sorted = true;
+          }
+
+          bool              sorted = true;
+       };
+
+       /**
+        *  Consensus latency per block from message timestamps.
+        *
+        *  For each message kind the view in which the most distinct producers (by public key) sent it is taken;
+        *  if that reaches the quorum, 2/3 of the producers plus one, the time from its first message to the
+        *  quorum-th distinct producer's message is the block's quorum latency, and every producer's message
+        *  in that view is measured against the moment the quorum was reached.
+        */
+       struct pbft_latency_analyzer {
+          explicit pbft_latency_analyzer( uint32_t producers ) : quorum( producers * 2 / 3 + 1 ) {}
+
+          void add( const pbft_state& s ) {
+             ++states;
+             int64_t prepare_quorum = 0, commit_quorum = 0;
+             const bool prepared = measure( s.prepares, prepare_latency, prepare_lag, prepare_quorum );
+             const bool committed = measure( s.commits, commit_latency, commit_lag, commit_quorum );
+             prepared_blocks += prepared;
+             committed_blocks += committed;
+             if( prepared && committed )
+                prepare_to_commit.add( commit_quorum - prepare_quorum );
+          }
+
+          void print( std::ostream& out ) {
+             out << "states: " << states << ", quorum: " << quorum << ", prepare quorum reached: " << prepared_blocks
+                 << ", commit quorum reached: " << committed_blocks << "\n";
+             prepare_latency.print_row( out, "first prepare -> prepare quorum" );
+             commit_latency.print_row( out, "first commit -> commit quorum" );
+             prepare_to_commit.print_row( out, "prepare quorum -> commit quorum" );
+             prepare_latency.print_histogram( out, "first prepare -> prepare quorum" );
+             commit_latency.print_histogram( out, "first commit -> commit quorum" );
+             out << "per producer lag behind the quorum (negative: part of the quorum):\n";
+             for( auto& p : prepare_lag )
+                p.second.print_row( out, "  prepare " + string( p.first ) );
+             for( auto& p : commit_lag )
+                p.second.print_row( out, "  commit " + string( p.first ) );
+          }
+
+       private:
+          /// returns true and the quorum time if a view of `msgs` reached the quorum
+          template<typename Message>
+          bool measure( const vector<Message>& msgs, latency_samples& latency,
+                        std::map<public_key_type, latency_samples>& lag, int64_t& quorum_time ) {
+             std::map<uint32_t, vector<const Message*>> views;
+             for( const auto& m : msgs )
+                views[m.view].push_back( &m );
+             const vector<const Message*>* best = nullptr;
+             size_t best_producers = 0;
+             for( auto& v : views ) {
+                std::sort( v.second.begin(), v.second.end(), []( const Message* a, const Message* b ) { return a->timestamp < b->timestamp; } );
+                // first message of each producer only
+                vector<const Message*> firsts;
+                for( auto m : v.second )
+                   if( std::none_of( firsts.begin(), firsts.end(), [&]( const Message* f ) { return f->public_key == m->public_key; } ) )
+                      firsts.push_back( m );
+                v.second = std::move( firsts );
+                if( v.second.size() > best_producers ) {
+                   best = &v.second;
+                   best_producers = v.second.size();
+                }
+             }
+             if( !best || best_producers < quorum )
+                return false;
+             const int64_t first = best->front()->timestamp.time_since_epoch().count();
+             quorum_time = (*best)[quorum - 1]->timestamp.time_since_epoch().count();
+             latency.add( quorum_time - first );
+             for( auto m : *best )
+                lag[m->public_key].add( m->timestamp.time_since_epoch().count() - quorum_time );
+             return true;
+          }
+
+          const uint32_t                              quorum;
+          uint64_t                                    states = 0;
+          uint64_t                                    prepared_blocks = 0;
+          uint64_t                                    committed_blocks = 0;
+          latency_samples                             prepare_latency;
+          latency_samples                             commit_latency;
+          latency_samples                             prepare_to_commit;
+          std::map<public_key_type, latency_samples>  prepare_lag;
+          std::map<public_key_type, latency_samples>  commit_lag;
+       };
+
+    }
+} /// namespace eosio::chain
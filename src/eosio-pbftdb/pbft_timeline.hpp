@@ -0,0 +1,239 @@
+#pragma once
+
+#include <fc/variant_object.hpp>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+
+#include "pbftdb_sidecar.hpp"
+
+namespace eosio {
+    namespace chain {
+
+       /**
+        *  One node's states with first <= block_num <= last in block number order, decoded ahead on a thread
+        *  of its own into a bounded queue.
+        *
+        *  The order comes from the sidecar index when it is fresh, otherwise from pbftdb_sidecar::scan(), a pass
+        *  over every state of the file that reads only their keys and keeps 16 bytes per state; either way only
+        *  the states in the range are decoded for the queue, and at most `capacity` of them are held at a time.
+        */
+       struct pbft_node_stream {
+          pbft_node_stream( const boost::filesystem::path& path, size_t capacity, uint32_t first, uint32_t last )
+          : reader( path ), capacity( capacity ), first( first ), last( last ) {
+             worker = std::thread( [this]() { run(); } );
+          }
+
+          ~pbft_node_stream() {
+             {
+                std::lock_guard<std::mutex> lock( mtx );
+                stopped = true;
+             }
+             cv.notify_all();
+             worker.join();
+          }
+
+          pbft_node_stream( const pbft_node_stream& ) = delete;
+          pbft_node_stream& operator=( const pbft_node_stream& ) = delete;
+
+          /// the next state, waiting for it to be decoded; nullptr after the last one
+          const pbft_state* front() {
+             std::unique_lock<std::mutex> lock( mtx );
+             cv.wait( lock, [this]() { return !queue.empty() || done; } );
+             if( !queue.empty() )
+                return &queue.front();
+             EOS_ASSERT( error.empty(), chain_exception, "Error reading ${f}: ${e}", ("f", reader.file.generic_string())("e", error) );
+             return nullptr;
+          }
+
+          void pop() {
+             {
+                std::lock_guard<std::mutex> lock( mtx );
+                queue.pop_front();
+             }
+             cv.notify_all();
+          }
+
+          pbftdb_reader                  reader;
+
+       private:
+          void run() {
+             try {
+                pbftdb_sidecar sidecar;
+                if( !sidecar.open( reader ) )
+                   sidecar.entries = pbftdb_sidecar::scan( reader );
+                const auto r = sidecar.range( first, last );
+                for( auto e = r.first; e != r.second; ++e ) {
+                   pbft_state s;
+                   reader.decode_at( e->offset, s );
+                   std::unique_lock<std::mutex> lock( mtx );
+                   cv.wait( lock, [this]() { return queue.size() < capacity || stopped; } );
+                   if( stopped )
+                      return;
+                   queue.push_back( std::move(s) );
+                   lock.unlock();
+                   cv.notify_all();
+                }
+             } catch( const fc::exception& e ) {
+                error = e.to_string();
+             } catch( const std::exception& e ) {
+                error = e.what();
+             }
+             {
+                std::lock_guard<std::mutex> lock( mtx );
+                done = true;
+             }
+             cv.notify_all();
+          }
+
+          const size_t                   capacity;
+          const uint32_t                 first;
+          const uint32_t                 last;
+          std::mutex                     mtx;
+          std::condition_variable        cv;
+          std::deque<pbft_state>         queue;   // push_back leaves the front in place for front()
+          bool                           done = false;
+          bool                           stopped = false;
+          string                         error;
+          std::thread                    worker;
+       };
+
+       /**
+        *  Unified prepare/commit timeline of several nodes' pbftdb.dat.
+        *
+        *  The node streams are k-way merged by block number; all states of one block number are gathered,
+        *  their messages deduplicated by uuid and grouped by view.  Each distinct message carries a bitset of
+        *  the nodes that stored it, so memory is bounded by the queues plus one block's messages.
+        */
+       struct pbft_timeline {
+          struct message {
+             const char*       kind = "";
+             string            uuid;
+             block_id_type     block_id;
+             public_key_type   public_key;
+             time_point        timestamp;
+          };
+
+          /// only blocks with first <= block_num <= last are read
+          pbft_timeline( const vector<boost::filesystem::path>& files, size_t capacity, uint32_t first, uint32_t last )
+          : nodes( files.size() ), words( (nodes + 63) / 64 ), last( last ), seen_count( nodes, 0 ), missing_count( nodes, 0 ) {
+             for( const auto& f : files )
+                streams.emplace_back( new pbft_node_stream( f, capacity, first, last ) );
+          }
+
+          /// calls `emit` once per block number and view, in increasing order
+          void run( const std::function<void( fc::variant&& )>& emit ) {
+             typedef std::pair<uint32_t, uint32_t> head;   // block_num, node
+             std::priority_queue<head, vector<head>, std::greater<head>> heads;
+             for( uint32_t i = 0; i < nodes; ++i )
+                if( auto s = streams[i]->front() )
+                   heads.emplace( s->block_num, i );
+
+             // the streams stop at `last` themselves; the check keeps the merge from waiting on them regardless
+             while( !heads.empty() && heads.top().first <= last ) {
+                const uint32_t num = heads.top().first;
+                vector<uint64_t> has_state( words, 0 );
+                while( !heads.empty() && heads.top().first == num ) {
+                   const uint32_t node = heads.top().second;
+                   heads.pop();
+                   set( has_state.data(), node );
+                   const pbft_state* s;
+                   while( (s = streams[node]->front()) && s->block_num == num ) {
+                      for( const auto& p : s->prepares )
+                         add( node, "prepare", p );
+                      for( const auto& c : s->commits )
+                         add( node, "commit", c );
+                      streams[node]->pop();
+                   }
+                   if( s )
+                      heads.emplace( s->block_num, node );
+                }
+                flush( num, has_state, emit );
+             }
+          }
+
+          const uint32_t                                  nodes;
+          const uint32_t                                  words;
+          const uint32_t                                  last;
+          vector<std::unique_ptr<pbft_node_stream>>       streams;
+          uint64_t                                        distinct = 0;
+          vector<uint64_t>                                seen_count;      ///< per node, distinct messages stored
+          vector<uint64_t>                                missing_count;   ///< per node, messages of blocks it has a state for but did not store
+
+       private:
+          struct view_group {
+             vector<message>                              messages;
+             vector<uint64_t>                             seen_bits;       // words per message
+             std::unordered_map<string, uint32_t>         by_uuid;
+          };
+
+          void set( uint64_t* bits, uint32_t node )const { bits[node / 64] |= uint64_t(1) << (node % 64); }
+          bool test( const uint64_t* bits, uint32_t node )const { return bits[node / 64] & (uint64_t(1) << (node % 64)); }
+
+          template<typename Message>
+          void add( uint32_t node, const char* kind, const Message& m ) {
+             auto& g = views[m.view];
+             auto itr = g.by_uuid.find( m.uuid );
+             uint32_t i;
+             if( itr == g.by_uuid.end() ) {
+                i = g.messages.size();
+                g.messages.push_back( message{ kind, m.uuid, m.block_id, m.public_key, m.timestamp } );
+                g.seen_bits.resize( g.seen_bits.size() + words, 0 );
+                g.by_uuid.emplace( m.uuid, i );
+             } else {
+                i = itr->second;
+             }
+             set( &g.seen_bits[size_t(i) * words], node );
+          }
+
+          void flush( uint32_t num, const vector<uint64_t>& has_state, const std::function<void( fc::variant&& )>& emit ) {
+             for( auto& v : views ) {
+                auto& g = v.second;
+                vector<uint32_t> order( g.messages.size() );
+                for( uint32_t i = 0; i < order.size(); ++i )
+                   order[i] = i;
+                std::sort( order.begin(), order.end(), [&]( uint32_t a, uint32_t b ) { return g.messages[a].timestamp < g.messages[b].timestamp; } );
+
+                vector<fc::variant> msgs;
+                msgs.reserve( order.size() );
+                for( auto i : order ) {
+                   const auto& m = g.messages[i];
+                   const uint64_t* bits = &g.seen_bits[size_t(i) * words];
+                   string seen( nodes, '0' ), missing( nodes, '0' );
+                   for( uint32_t n = 0; n < nodes; ++n ) {
+                      if( test( bits, n ) ) {
+                         seen[n] = '1';
+                         ++seen_count[n];
+                      } else if( test( has_state.data(), n ) ) {
+                         missing[n] = '1';
+                         ++missing_count[n];
+                      }
+                   }
+                   msgs.emplace_back( fc::mutable_variant_object( "kind", m.kind )( "timestamp", m.timestamp )( "uuid", m.uuid )
+                                                                ( "block_id", m.block_id )( "public_key", m.public_key )
+                                                                ( "seen", seen )( "missing", missing ) );
+                }
+                distinct += msgs.size();
+
+                string with_state( nodes, '0' );
+                for( uint32_t n = 0; n < nodes; ++n )
+                   if( test( has_state.data(), n ) )
+                      with_state[n] = '1';
+                emit( fc::variant( fc::mutable_variant_object( "block_num", num )( "view", v.first )
+                                                              ( "nodes_with_state", with_state )( "messages", msgs ) ) );
+             }
+             views.clear();
+          }
+
+          std::map<uint32_t, view_group>                  views;
+       };
+
+    }
+} /// namespace eosio::chain
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <fc/io/fstream.hpp>
+
+#include <cerrno>
+
+#include "checkpoints.hpp"
+#include "pbftdb_reader.hpp"
+
+namespace eosio {
+    namespace chain {
+
+       /// block number of the highest stable checkpoint in checkpoints.dat, 0 if there is none
+       inline uint32_t last_stable_checkpoint( const boost::filesystem::path& file ) {
+          EOS_ASSERT( boost::filesystem::exists( file ), chain_exception, "${f} does not exist", ("f", file.generic_string()) );
+          string content;
+          fc::read_file_contents( file, content );
+          fc::datastream<const char*> ds( content.data(), content.size() );
+          unsigned_int size;
+          fc::raw::unpack( ds, size );
+          uint32_t stable = 0;
+          pbft_checkpoint_state s;
+          for( uint32_t i = 0; i < size.value; ++i ) {
+             fc::raw::unpack( ds, s );
+             if( s.is_stable )
+                stable = std::max( stable, s.block_num );
+          }
+          return stable;
+       }
+
+       inline void write_all( int fd, const char* data, size_t size, const string& file ) {
+          while( size > 0 ) {
+             const auto w = ::write( fd, data, size );
+             if( w < 0 && errno == EINTR )
+                continue;
+             EOS_ASSERT( w > 0, chain_exception, "Error writing ${f}", ("f", file) );
+             data += w;
+             size -= w;
+          }
+       }
+
+       struct pbftdb_compaction {
+          uint32_t   kept = 0;
+          uint32_t   dropped = 0;
+          uint64_t   old_size = 0;
+          uint64_t   new_size = 0;
+       };
+
+       /**
+        *  Rewrites the reader's file without the states below `keep_from`, in the same current_view, count,
+        *  states layout.  One decoding pass finds the byte runs of the kept states, which are then copied
+        *  from the mapping as they are.  The result goes to a temporary file that is synced, renamed over the
+        *  original and made durable by syncing the directory; on failure the temporary file is removed.
+        */
+       inline pbftdb_compaction compact_pbftdb( pbftdb_reader& reader, uint32_t keep_from ) {
+          pbftdb_compaction r;
+          r.old_size = reader.size;
+
+          // kept states usually form a few long runs, so this stays small however large the file is
+          vector<std::pair<uint64_t, uint64_t>> runs;
+          reader.rewind();
+          pbft_state s;
+          for( uint64_t pos = reader.position(); reader.next( s ); pos = reader.position() ) {
+             if( s.block_num < keep_from ) {
+                ++r.dropped;
+                continue;
+             }
+             ++r.kept;
+             if( !runs.empty() && runs.back().second == pos )
+                runs.back().second = reader.position();
+             else
+                runs.emplace_back( pos, reader.position() );
+          }
+          if( r.dropped == 0 ) {
+             r.new_size = r.old_size;
+             return r;
+          }
+
+          const auto tmp = reader.file.string() + ".tmp";
+          int fd = ::open( tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+          EOS_ASSERT( fd >= 0, chain_exception, "Unable to create ${f}", ("f", tmp) );
+          try {
+             const auto view = fc::raw::pack( reader.current_view );
+             const auto count = fc::raw::pack( unsigned_int( r.kept ) );
+             write_all( fd, view.data(), view.size(), tmp );
+             write_all( fd, count.data(), count.size(), tmp );
+             r.new_size = view.size() + count.size();
+             for( const auto& run : runs ) {
+                write_all( fd, reader.raw() + run.first, run.second - run.first, tmp );
+                r.new_size += run.second - run.first;
+             }
+             // the data must be on disk before the rename makes it the only copy
+             EOS_ASSERT( ::fsync( fd ) == 0, chain_exception, "Unable to sync ${f}", ("f", tmp) );
+             const int rc = ::close( fd );
+             fd = -1;
+             EOS_ASSERT( rc == 0, chain_exception, "Error writing ${f}", ("f", tmp) );
+             boost::filesystem::rename( tmp, reader.file );
+          } catch( ... ) {
+             if( fd >= 0 )
+                ::close( fd );
+             boost::system::error_code ec;
+             boost::filesystem::remove( tmp, ec );
+             throw;
+          }
+
+          // and the rename itself, through the directory entry
+          const auto dir = reader.file.has_parent_path() ? reader.file.parent_path() : boost::filesystem::path( "." );
+          const int dir_fd = ::open( dir.generic_string().c_str(), O_RDONLY | O_DIRECTORY );
+          EOS_ASSERT( dir_fd >= 0, chain_exception, "Unable to open ${d}", ("d", dir.generic_string()) );
+          const int rc = ::fsync( dir_fd );
+          ::close( dir_fd );
+          EOS_ASSERT( rc == 0, chain_exception, "Unable to sync ${d}", ("d", dir.generic_string()) );
+          return r;
+       }
+
+    }
+} /// namespace eosio::chain
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <fc/io/raw.hpp>
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/path.hpp>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "pbft_database.hpp"
+#include "pbft_flat_store.hpp"
+
+namespace eosio {
+    namespace chain {
+
+       /**
+        *  Streaming reader over a memory mapped pbftdb.dat.
+        *
+        *  pbftdb.dat layout: uint32 current_view, unsigned_int count, then count packed pbft_states.
+        *  next() decodes one state at a time into a caller owned object, so a pass over the file holds one
+        *  state in memory; load() builds the multi_index or the flat store for queries that need random access.
+        */
+       struct pbftdb_reader {
+          /// `path` is either pbftdb.dat itself or the directory holding it
+          explicit pbftdb_reader( const boost::filesystem::path& path ) {
+             file = boost::filesystem::is_directory( path ) ? path / "pbftdb.dat" : path;
+             fd = ::open( file.generic_string().c_str(), O_RDONLY );
+             EOS_ASSERT( fd >= 0, chain_exception, "Unable to open ${f}", ("f", file.generic_string()) );
+             struct stat st;
+             ::fstat( fd, &st );
+             size = st.st_size;
+             if( size > 0 ) {
+                void* p = ::mmap( nullptr, size, PROT_READ, MAP_SHARED, fd, 0 );
+                if( p == MAP_FAILED ) {
+                   ::close( fd );
+                   EOS_THROW( chain_exception, "Unable to map ${f}", ("f", file.generic_string()) );
+                }
+                data = static_cast<const char*>( p );
+                ::madvise( p, size, MADV_SEQUENTIAL );
+             }
+             try {
+                rewind();
+             } catch( ... ) {
+                // truncated header; the destructor does not run for a throwing constructor
+                if( data )
+                   ::munmap( const_cast<char*>(data), size );
+                ::close( fd );
+                throw;
+             }
+          }
+
+          ~pbftdb_reader() {
+             if( data )
+                ::munmap( const_cast<char*>(data), size );
+             ::close( fd );
+          }
+
+          pbftdb_reader( const pbftdb_reader& ) = delete;
+          pbftdb_reader& operator=( const pbftdb_reader& ) = delete;
+
+          /// back to the first state
+          void rewind() {
+             ds = fc::datastream<const char*>( data, size );
+             current_view = 0;
+             count = 0;
+             read = 0;
+             if( size == 0 )
+                return;
+             unsigned_int n;
+             fc::raw::unpack( ds, current_view );
+             fc::raw::unpack( ds, n );
+             count = n.value;
+          }
+
+          /// decodes the next state into `s`; returns false after the last one
+          bool next( pbft_state& s ) {
+             if( read >= count )
+                return false;
+             fc::raw::unpack( ds, s );
+             ++read;
+             return true;
+          }
+
+          /// block id and number of the next state, stepping over its messages by their lengths; returns false after the last one
+          bool next_key( block_id_type& id, block_num_type& num ) {
+             if( read >= count )
+                return false;
+             fc::raw::unpack( ds, id );
+             fc::raw::unpack( ds, num );
+             skip_messages();   // prepares
+             skip( 1 );         // should_prepared
+             skip_messages();   // commits
+             skip( 1 );         // should_committed
+             ++read;
+             return true;
+          }
+
+          /// decodes the state starting at `offset`, e.g. from a sidecar index, without moving the stream
+          void decode_at( uint64_t offset, pbft_state& s )const {
+             EOS_ASSERT( offset < size, chain_exception, "Offset ${o} is past the end of ${f}", ("o", offset)("f", file.generic_string()) );
+             fc::datastream<const char*> at( data + offset, size - offset );
+             fc::raw::unpack( at, s );
+          }
+
+          /// offset of the next state in the file
+          uint64_t position()const { return ds.pos() - data; }
+
+          /// the mapped file, for copying packed states without decoding them again
+          const char* raw()const { return data; }
+
+          /// every remaining state into the index
+          void load( pbft_state_multi_index_type& index ) {
+             pbft_state s;
+             while( next( s ) )
+                index.insert( std::make_shared<pbft_state>( std::move(s) ) );
+          }
+
+          /// every remaining state into the flat store, which is finished afterwards
+          void load( pbft_flat_store& store ) {
+             store.states.reserve( count - read );
+             pbft_state s;
+             while( next( s ) )
+                store.add( s );
+             store.finish();
+          }
+
+          boost::filesystem::path        file;
+          uint64_t                       size = 0;
+          uint32_t                       current_view = 0;
+          uint32_t                       count = 0;
+          uint32_t                       read = 0;
+
+       private:
+          void skip( size_t n ) {
+             EOS_ASSERT( ds.remaining() >= n, chain_exception, "State at ${o} runs past the end of ${f}", ("o", position())("f", file.generic_string()) );
+             ds.skip( n );
+          }
+
+          /// a packed vector of pbft_prepare or pbft_commit, whose fields are the same; only the key and signature,
+          /// whose packed size depends on their type, are unpacked
+          void skip_messages() {
+             unsigned_int n;
+             fc::raw::unpack( ds, n );
+             for( uint32_t i = 0; i < n.value; ++i ) {
+                unsigned_int uuid_size;
+                fc::raw::unpack( ds, uuid_size );
+                skip( size_t(uuid_size.value) + sizeof(uint32_t) + sizeof(block_num_type) + sizeof(block_id_type) );
+                fc::raw::unpack( ds, skipped_key );
+                skip( sizeof(fc::sha256) );
+                fc::raw::unpack( ds, skipped_signature );
+                skip( sizeof(int64_t) );   // timestamp
+             }
+          }
+
+          int                            fd = -1;
+          const char*                    data = nullptr;
+          fc::datastream<const char*>    ds{ nullptr, 0 };
+          public_key_type                skipped_key;
+          signature_type                 skipped_signature;
+       };
+
+    }
+} /// namespace eosio::chain
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <fc/crypto/sha256.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <unordered_set>
+
+#include "pbftdb_reader.hpp"
+
+namespace eosio {
+    namespace chain {
+
+       const uint64_t pbftdb_sidecar_magic = 0x3258444954464250ull;   // "PBFTIDX2"
+
+       /**
+        *  Sorted on-disk index next to pbftdb.dat (pbftdb.dat.idx), for range queries on files too large to load.
+        *
+        *  Layout: uint64 magic, then of the indexed file uint64 size, int64 mtime, uint32 current_view, uint32
+        *  state count and the sha256 of its first and last 4 KiB; uint32 count, then count entries of uint32
+        *  block_num, uint32 padding, uint64 offset, sorted by block number.  An index whose recorded file
+        *  details no longer match the data file is ignored; the digest catches a rewrite within the same
+        *  second that kept the size.
+        *
+        *  Like the block id index of pbft_state_multi_index_type, only the first state of each block id in
+        *  file order is indexed.
+        */
+       struct pbftdb_sidecar {
+          struct entry {
+             uint32_t   block_num = 0;
+             uint32_t   reserved = 0;
+             uint64_t   offset = 0;
+          };
+
+          static boost::filesystem::path path_for( const boost::filesystem::path& data_file ) {
+             return data_file.string() + ".idx";
+          }
+
+          static fc::sha256 fingerprint( const pbftdb_reader& reader ) {
+             const uint64_t n = std::min<uint64_t>( reader.size, 4096 );
+             fc::sha256::encoder enc;
+             enc.write( reader.raw(), n );
+             enc.write( reader.raw() + reader.size - n, n );
+             return enc.result();
+          }
+
+          /**
+           *  One streaming pass over the data file that reads only the block id and number of each state and
+           *  steps over its messages.  The sorted entries are kept in memory only: 16 bytes per state, plus the
+           *  set of block ids seen while the pass runs.
+           */
+          static vector<entry> scan( pbftdb_reader& reader ) {
+             vector<entry> entries;
+             entries.reserve( reader.count );
+             std::unordered_set<block_id_type> seen;
+             seen.reserve( reader.count );
+             reader.rewind();
+             block_id_type id;
+             block_num_type num = 0;
+             for( uint64_t pos = reader.position(); reader.next_key( id, num ); pos = reader.position() )
+                if( seen.insert( id ).second )
+                   entries.push_back( entry{ num, 0, pos } );
+             std::stable_sort( entries.begin(), entries.end(), []( const entry& a, const entry& b ) { return a.block_num < b.block_num; } );
+             return entries;
+          }
+
+          static void build( pbftdb_reader& reader ) {
+             const auto entries = scan( reader );
+
+             const auto target = path_for( reader.file );
+             const auto tmp = target.string() + ".tmp";
+             {
+                std::ofstream out( tmp.c_str(), std::ios::binary | std::ios::trunc );
+                EOS_ASSERT( out.good(), chain_exception, "Unable to create ${f}", ("f", tmp) );
+                const uint64_t size = reader.size;
+                const int64_t mtime = boost::filesystem::last_write_time( reader.file );
+                const auto digest = fingerprint( reader );
+                const uint32_t count = entries.size();
+                out.write( (const char*)&pbftdb_sidecar_magic, sizeof(pbftdb_sidecar_magic) );
+                out.write( (const char*)&size, sizeof(size) );
+                out.write( (const char*)&mtime, sizeof(mtime) );
+                out.write( (const char*)&reader.current_view, sizeof(reader.current_view) );
+                out.write( (const char*)&reader.count, sizeof(reader.count) );
+                out.write( digest.data(), digest.data_size() );
+                out.write( (const char*)&count, sizeof(count) );
+                out.write( (const char*)entries.data(), entries.size() * sizeof(entry) );
+                out.flush();
+                EOS_ASSERT( out.good(), chain_exception, "Error writing ${f}", ("f", tmp) );
+             }
+             boost::filesystem::rename( tmp, target );
+          }
+
+          /// returns false if there is no index or it is stale
+          bool open( const pbftdb_reader& reader ) {
+             std::ifstream in( path_for( reader.file ).generic_string().c_str(), std::ios::binary );
+             if( !in.good() )
+                return false;
+             uint64_t m = 0, size = 0;
+             int64_t mtime = 0;
+             uint32_t view = 0, states = 0, count = 0;
+             fc::sha256 digest;
+             in.read( (char*)&m, sizeof(m) );
+             in.read( (char*)&size, sizeof(size) );
+             in.read( (char*)&mtime, sizeof(mtime) );
+             in.read( (char*)&view, sizeof(view) );
+             in.read( (char*)&states, sizeof(states) );
+             in.read( digest.data(), digest.data_size() );
+             in.read( (char*)&count, sizeof(count) );
+             if( !in.good() || m != pbftdb_sidecar_magic || size != reader.size || mtime != int64_t(boost::filesystem::last_write_time( reader.file ))
+                 || view != reader.current_view || states != reader.count || digest != fingerprint( reader ) )
+                return false;
+             entries.resize( count );
+             in.read( (char*)entries.data(), entries.size() * sizeof(entry) );
+             return !in.fail();
+          }
+
+          /// entries with first <= block_num <= last
+          std::pair<vector<entry>::const_iterator, vector<entry>::const_iterator> range( uint32_t first, uint32_t last )const {
+             auto lo = std::lower_bound( entries.begin(), entries.end(), first, []( const entry& e, uint32_t n ) { return e.block_num < n; } );
+             auto hi = std::upper_bound( lo, entries.end(), last, []( uint32_t n, const entry& e ) { return n < e.block_num; } );
+             return std::make_pair( lo, hi );
+          }
+
+          vector<entry>   entries;
+       };
+
+    }
+} /// namespace eosio::chain
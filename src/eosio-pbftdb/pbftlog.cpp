@@ -17,7 +17,18 @@
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/path.hpp>
 
+#include <atomic>
+#include <map>
+#include <thread>
+#include <unordered_set>
+
 #include "pbft_database.hpp"
+#include "pbft_flat_store.hpp"
+#include "pbft_latency.hpp"
+#include "pbft_timeline.hpp"
+#include "pbftdb_compactor.hpp"
+#include "pbftdb_reader.hpp"
+#include "pbftdb_sidecar.hpp"
 
 
 using namespace eosio::chain;
@@ -33,6 +44,11 @@ struct blocklog {
    {}
 
    void read_log();
+   bool verify();
+   void report_latency();
+   void merge_nodes();
+   void compact();
+   std::ostream* open_output(std::ofstream& file, std::vector<char>& buffer);
    void set_program_options(options_description& cli);
    void initialize(const variables_map& options);
 
@@ -50,6 +66,20 @@ struct blocklog {
    uint32_t                         pack_headers_from;
    uint32_t                         pack_headers_interval;
    uint32_t                         pack_headers_times;
+
+   bool                             file_order;
+   bool                             flat;
+   block_id_type                    block_id;
+   bool                             build_index;
+   bool                             verify_only;
+   fc::sha256                       chain_id;
+   uint32_t                         threads;
+   bool                             latency;
+   uint32_t                         producers;
+   std::vector<bfs::path>           merge_files;
+   bool                             compact_only;
+   uint32_t                         keep_from;
+   bfs::path                        checkpoints_file;
 };
 
 template <typename T>
@@ -75,65 +105,315 @@ FC_REFLECT_DERIVED(transaction_receipt_type, (eosio::chain::transaction_receipt_
 
 void blocklog::read_log() {
 
-   std::ostream* out = &std::cout;
+   std::vector<char> output_buffer;
+   std::ofstream output_states;
+   std::ostream* out = open_output(output_states, output_buffer);
    fc::variant pretty_output;
    const fc::microseconds deadline = fc::seconds(10);
-   auto print_info = [&](pbft_state& next) {
+   bool contains_obj = false;
+   auto print_info = [&](const pbft_state& next) {
       abi_serializer::to_variant(next, pretty_output, []( account_name n ) { return optional<abi_serializer>(); }, deadline);
       const auto enhanced_object = fc::mutable_variant_object
          (pretty_output.get_object());
       fc::variant v(std::move(enhanced_object));
+      if (as_json_array && contains_obj)
+         *out << ",";
       if (no_pretty_print)
          fc::json::to_stream(*out, v, fc::json::stringify_large_ints_and_doubles);
       else
          *out << fc::json::to_pretty_string(v) << "\n";
+      contains_obj = true;
    };
 
-   fc::path pbft_db_dir = blocks_dir;
-   auto pbft_db_dat = pbft_db_dir / "pbftdb.dat";
-   if (fc::exists(pbft_db_dat)) {
-      string content;
-      fc::read_file_contents(pbft_db_dat, content);
+   auto pbft_db_dat = bfs::is_directory(blocks_dir) ? blocks_dir / "pbftdb.dat" : blocks_dir;
+   if (!fc::exists(pbft_db_dat))
+      return;
+   pbftdb_reader reader(pbft_db_dat);
+
+   if (build_index) {
+      pbftdb_sidecar::build(reader);
+      std::cout << "wrote " << pbftdb_sidecar::path_for(reader.file).generic_string() << " for " << reader.count << " state(s)" << std::endl;
+      return;
+   }
 
-      fc::datastream<const char *> ds(content.data(), content.size());
+   if (info) {
+      pbft_state s;
+      uint32_t lowest = std::numeric_limits<uint32_t>::max(), highest = 0, prepared = 0, committed = 0;
+      uint64_t prepares = 0, commits = 0;
+      while (reader.next(s)) {
+         lowest = std::min(lowest, s.block_num);
+         highest = std::max(highest, s.block_num);
+         prepared += s.should_prepared;
+         committed += s.should_committed;
+         prepares += s.prepares.size();
+         commits += s.commits.size();
+      }
+      *out << "pbftdb.dat current view " << reader.current_view << ", " << reader.count << " state(s)";
+      if (reader.count > 0)
+         *out << ": [ " << lowest << " - " << highest << " ], " << prepared << " prepared, " << committed << " committed, "
+              << prepares << " prepare(s), " << commits << " commit(s)";
+      *out << std::endl;
+      return;
+   }
 
-      // keep these unused variables.
-      uint32_t current_view;
-      fc::raw::unpack(ds, current_view);
+   if (as_json_array)
+      *out << "[";
 
-      unsigned_int size;
-      fc::raw::unpack(ds, size);
-      for (uint32_t i = 0, n = size.value; i < n; ++i) {
-         pbft_state s;
-         fc::raw::unpack(ds, s);
-         pbft_state_index.insert(std::make_shared<pbft_state>(move(s)));
+   // a block id carries its block number, so a point lookup is a one block range query
+   const bool by_id = block_id != block_id_type();
+   const uint32_t first = by_id ? block_header::num_from_id(block_id) : first_block;
+   const uint32_t last = by_id ? first : last_block;
+   const bool ranged = by_id || first_block > 1 || last_block < std::numeric_limits<uint32_t>::max();
+
+   pbftdb_sidecar sidecar;
+   if (ranged && sidecar.open(reader)) {
+      pbft_state s;
+      const auto r = sidecar.range(first, last);
+      for (auto itr = r.first; itr != r.second; ++itr) {
+         reader.decode_at(itr->offset, s);
+         if (!by_id || s.block_id == block_id)
+            print_info(s);
+      }
+   } else if (flat && !file_order) {
+      pbft_flat_store store;
+      reader.load(store);
+      if (by_id) {
+         const auto i = store.find(block_id);
+         if (i >= 0)
+            print_info(store.get(i));
+      } else if (ranged) {
+         const auto r = store.range(first, last);
+         for (auto i = r.first; i != r.second; ++i)
+            print_info(store.get(i));
+      } else {
+         for (auto i : store.by_commit_and_num)
+            print_info(store.get(i));
+      }
+   } else if (by_id) {
+      reader.load(pbft_state_index);
+      const auto& by_block_id_index = pbft_state_index.get<by_block_id>();
+      auto itr = by_block_id_index.find(block_id);
+      if (itr != by_block_id_index.end())
+         print_info(**itr);
+   } else if (ranged) {
+      reader.load(pbft_state_index);
+      const auto& by_num_index = pbft_state_index.get<by_num>();
+      auto end = by_num_index.upper_bound(boost::make_tuple(last));
+      for (auto itr = by_num_index.lower_bound(boost::make_tuple(first)); itr != end; ++itr)
+         print_info(**itr);
+   } else if (file_order) {
+      // one state at a time, nothing kept
+      pbft_state s;
+      while (reader.next(s))
+         print_info(s);
+   } else {
+      reader.load(pbft_state_index);
+      const auto &by_commit_and_num_index = pbft_state_index.get<by_commit_and_num>();
+      for ( auto itr = by_commit_and_num_index.begin(); itr != by_commit_and_num_index.end(); itr++ ){
+         pbft_state_ptr psp = *itr;
+         print_info(*psp);
       }
    }
 
-   const auto &by_commit_and_num_index = pbft_state_index.get<by_commit_and_num>();
-   for ( auto itr = by_commit_and_num_index.begin(); itr != by_commit_and_num_index.end(); itr++ ){
-      pbft_state_ptr psp = *itr;
-      print_info(*psp);
+   if (as_json_array)
+      *out << "]";
+   out->flush();
+}
+
+std::ostream* blocklog::open_output(std::ofstream& file, std::vector<char>& buffer) {
+   if (output_file.empty())
+      return &std::cout;
+   // large buffer, the json of a busy view is written in many small pieces; the caller declares it before
+   // the stream so it is still alive when the stream flushes on destruction
+   buffer.resize(1 << 20);
+   file.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+   file.open(output_file.generic_string().c_str());
+   EOS_ASSERT( !file.fail(), fc::invalid_arg_exception, "Unable to open file '${f}'", ("f", output_file.string()) );
+   return &file;
+}
+
+/// digest signed by the producer: every field of the message except the signature, in declaration order
+template<typename Message>
+digest_type message_digest(const Message& m) {
+   digest_type::encoder enc;
+   fc::raw::pack(enc, m.uuid);
+   fc::raw::pack(enc, m.view);
+   fc::raw::pack(enc, m.block_num);
+   fc::raw::pack(enc, m.block_id);
+   fc::raw::pack(enc, m.public_key);
+   fc::raw::pack(enc, m.chain_id);
+   fc::raw::pack(enc, m.timestamp);
+   return enc.result();
+}
+
+struct signed_message {
+   const char*       kind = "";
+   uint32_t          block_num = 0;
+   string            uuid;
+   digest_type       digest;
+   signature_type    signature;
+   public_key_type   public_key;
+   fc::sha256        chain_id;
+   string            error;
+};
+
+bool blocklog::verify() {
+   auto pbft_db_dat = bfs::is_directory(blocks_dir) ? blocks_dir / "pbftdb.dat" : blocks_dir;
+   pbftdb_reader reader(pbft_db_dat);
+   std::vector<char> output_buffer;
+   std::ofstream output_states;
+   std::ostream* out = open_output(output_states, output_buffer);
+
+   const size_t batch_size = 16 * 1024;
+   std::vector<signed_message> batch;
+   batch.reserve(batch_size);
+   std::unordered_set<string> seen;
+   std::map<fc::sha256, uint64_t> chain_ids;
+   uint64_t total = 0, duplicates = 0, invalid = 0;
+   const bool check_chain_id = chain_id != fc::sha256();
+
+   // key recovery dominates; digests are computed while reading, recovery is spread over the pool per batch
+   auto verify_batch = [&]() {
+      std::atomic<size_t> next{0};
+      auto work = [&]() {
+         for (size_t i = next++; i < batch.size(); i = next++) {
+            auto& m = batch[i];
+            try {
+               if (public_key_type(m.signature, m.digest, true) != m.public_key)
+                  m.error = "signature does not match public_key";
+            } catch (const fc::exception& e) {
+               m.error = "unable to recover key: " + e.to_string();
+            }
+         }
+      };
+      std::vector<std::thread> workers;
+      for (uint32_t t = 1; t < std::min<size_t>(threads, batch.size()); ++t)
+         workers.emplace_back(work);
+      work();
+      for (auto& w : workers)
+         w.join();
+      for (auto& m : batch) {
+         if (m.error.empty() && check_chain_id && m.chain_id != chain_id)
+            m.error = "chain_id " + m.chain_id.str() + " is not the expected chain";
+         if (!m.error.empty()) {
+            ++invalid;
+            *out << m.kind << " " << m.block_num << " " << m.uuid << ": " << m.error << "\n";
+         }
+      }
+      batch.clear();
+   };
+   auto add = [&](const char* kind, const auto& msg) {
+      ++total;
+      if (!seen.insert(msg.uuid).second) {
+         ++duplicates;
+         return;
+      }
+      ++chain_ids[msg.chain_id];
+      batch.push_back(signed_message{kind, msg.block_num, msg.uuid, message_digest(msg), msg.producer_signature, msg.public_key, msg.chain_id});
+      if (batch.size() >= batch_size)
+         verify_batch();
+   };
+
+   const auto start = fc::time_point::now();
+   pbft_state s;
+   while (reader.next(s)) {
+      for (const auto& p : s.prepares)
+         add("prepare", p);
+      for (const auto& c : s.commits)
+         add("commit", c);
    }
+   verify_batch();
+   const auto elapsed = std::max<int64_t>(1, (fc::time_point::now() - start).count());
+
+   if (!check_chain_id)
+      for (const auto& c : chain_ids)
+         *out << "chain_id " << c.first.str() << ": " << c.second << " message(s)\n";
+   const uint64_t verified = total - duplicates;
+   *out << "messages: " << total << ", duplicates skipped: " << duplicates << ", verified: " << verified
+        << ", invalid: " << invalid << ", " << uint64_t(verified * 1e6 / elapsed) << " msg/s using " << threads << " thread(s)" << std::endl;
+   return invalid == 0 && (check_chain_id || chain_ids.size() <= 1);
+}
+
+void blocklog::report_latency() {
+   auto pbft_db_dat = bfs::is_directory(blocks_dir) ? blocks_dir / "pbftdb.dat" : blocks_dir;
+   pbftdb_reader reader(pbft_db_dat);
+   std::vector<char> output_buffer;
+   std::ofstream output_states;
+   std::ostream* out = open_output(output_states, output_buffer);
+
+   pbft_latency_analyzer analyzer(producers);
+   pbft_state s;
+   while (reader.next(s))
+      if (s.block_num >= first_block && s.block_num <= last_block)
+         analyzer.add(s);
+   analyzer.print(*out);
+   out->flush();
+}
+
+void blocklog::merge_nodes() {
+   std::vector<char> output_buffer;
+   std::ofstream output_states;
+   std::ostream* out = open_output(output_states, output_buffer);
+
+   // a few hundred states per node in flight keeps every decoder busy without holding any file in memory
+   pbft_timeline timeline(merge_files, 256, first_block, last_block);
+   bool contains_obj = false;
+   if (as_json_array)
+      *out << "[";
+   timeline.run([&](fc::variant&& v) {
+      if (as_json_array && contains_obj)
+         *out << ",";
+      if (no_pretty_print)
+         fc::json::to_stream(*out, v, fc::json::stringify_large_ints_and_doubles);
+      else
+         *out << fc::json::to_pretty_string(v);
+      *out << "\n";
+      contains_obj = true;
+   });
+   if (as_json_array)
+      *out << "]";
+   out->flush();
+
+   std::cerr << timeline.distinct << " distinct message(s) from " << timeline.nodes << " node(s)\n";
+   for (uint32_t i = 0; i < timeline.nodes; ++i)
+      std::cerr << "node " << i << " " << timeline.streams[i]->reader.file.generic_string() << ": " << timeline.seen_count[i]
+                << " seen, " << timeline.missing_count[i] << " missing" << std::endl;
+}
+
+void blocklog::compact() {
+   auto pbft_db_dat = bfs::is_directory(blocks_dir) ? blocks_dir / "pbftdb.dat" : blocks_dir;
+   pbftdb_reader reader(pbft_db_dat);
+
+   uint32_t from = keep_from;
+   if (from == 0) {
+      auto checkpoints_dat = checkpoints_file.empty() ? reader.file.parent_path() / "checkpoints.dat" : checkpoints_file;
+      from = last_stable_checkpoint(checkpoints_dat);
+      std::cout << "last stable checkpoint in " << checkpoints_dat.generic_string() << ": " << from << std::endl;
+      EOS_ASSERT( from > 0, fc::invalid_arg_exception, "No stable checkpoint, nothing to prune below; use --keep-from" );
+   }
+
+   const auto r = compact_pbftdb(reader, from);
+   std::cout << reader.file.generic_string() << ": kept " << r.kept << " state(s) from block " << from << ", dropped " << r.dropped
+             << ", " << r.old_size << " -> " << r.new_size << " bytes, " << r.old_size - r.new_size << " reclaimed" << std::endl;
 }
 
 void blocklog::set_program_options(options_description& cli)
 {
    cli.add_options()
       ("blocks-dir,d", bpo::value<bfs::path>()->default_value("blocks"),
-       "the location of the blocks directory (absolute path or relative to the current directory)")
+       "the pbftdb.dat file or the directory containing it (absolute path or relative to the current directory)")
       ("output-file,o", bpo::value<bfs::path>(),
        "the file to write the block log output to (absolute or relative path).  If not specified then output is to stdout.")
       ("first,f", bpo::value<uint32_t>(&first_block)->default_value(1),
-       "the first block number to log")
+       "the first block number to print; with --first or --last the states are printed in block number order")
       ("last,l", bpo::value<uint32_t>(&last_block)->default_value(std::numeric_limits<uint32_t>::max()),
-       "the last block number (inclusive) to log")
+       "the last block number (inclusive) to print")
       ("no-pretty-print", bpo::bool_switch(&no_pretty_print)->default_value(false),
        "Do not pretty print the output.  Useful if piping to jq to improve performance.")
       ("as-json-array", bpo::bool_switch(&as_json_array)->default_value(false),
        "Print out json blocks wrapped in json array (otherwise the output is free-standing json objects).")
       ("info,i", bpo::bool_switch(&info)->default_value(false),
-       "Only print the first and last block number in forkdb of current chain.")
+       "Only print the current view, the number of states, their block range and message counts.")
       ("print-packed-header", bpo::bool_switch(&print_packed_header)->default_value(false),
        "Print packed header.")
       ("print-packed-trx", bpo::bool_switch(&print_packed_trx)->default_value(false),
@@ -144,6 +424,39 @@ void blocklog::set_program_options(options_description& cli)
        "Packed headers amount.")
       ("pack-headers-times", bpo::value<uint32_t>(&pack_headers_times)->default_value(1),
        "Print Packed headers times.")
+      ("file-order", bpo::bool_switch(&file_order)->default_value(false),
+       "Print the states in file order while streaming through the file, instead of loading them all and sorting them by commit status and block number.")
+      ("flat", bpo::bool_switch(&flat)->default_value(false),
+       "Load the states into flat block number sorted arrays with permutation indexes instead of the multi_index; "
+       "same output, less memory and faster to build on large files.  Message uuids must be canonical uuids.")
+      ("block-id", bpo::value<string>(),
+       "Print only the state of this block id.")
+      ("build-index", bpo::bool_switch(&build_index)->default_value(false),
+       "Write a sorted block number index next to pbftdb.dat (pbftdb.dat.idx); --first/--last and --block-id then "
+       "seek through it instead of loading every state.")
+      ("verify", bpo::bool_switch(&verify_only)->default_value(false),
+       "Verify the signature of every prepare and commit against its public_key, once per uuid, and their chain_id.")
+      ("chain-id", bpo::value<string>(),
+       "Expected chain_id for --verify; without it the tool only checks that all messages agree.")
+      ("latency", bpo::bool_switch(&latency)->default_value(false),
+       "Report prepare and commit quorum latency per block, per producer lag behind the quorum, percentiles and histograms "
+       "for the states in --first/--last.")
+      ("producers", bpo::value<uint32_t>(&producers)->default_value(21),
+       "Number of producers in the schedule; --latency takes 2/3 of them plus one as the quorum.")
+      ("merge", bpo::value<std::vector<bfs::path>>(&merge_files)->composing()->multitoken(),
+       "Merge the pbftdb.dat of several nodes into one timeline ordered by block number and view, each message once with "
+       "a seen bitmap over the nodes (in argument order) and a missing bitmap of the nodes that have a state for the block "
+       "but not the message.  Honours --first/--last.  Without a fresh --build-index sidecar next to a file, that node "
+       "costs a pass over all of its states and 16 bytes of memory per state before the range is read, however narrow it is.")
+      ("compact", bpo::bool_switch(&compact_only)->default_value(false),
+       "Rewrite pbftdb.dat in place, with the node stopped, without the states below --keep-from or, by default, below "
+       "the last stable checkpoint in checkpoints.dat.")
+      ("keep-from", bpo::value<uint32_t>(&keep_from)->default_value(0),
+       "Lowest block number whose states --compact keeps; 0 takes the last stable checkpoint.")
+      ("checkpoints", bpo::value<bfs::path>(&checkpoints_file),
+       "checkpoints.dat for --compact, if it is not next to pbftdb.dat.")
+      ("threads,t", bpo::value<uint32_t>(&threads)->default_value(std::max(1u, std::thread::hardware_concurrency())),
+       "Number of worker threads for --verify.")
       ("help,h", "Print this help message and exit.")
       ;
 
@@ -157,6 +470,14 @@ void blocklog::initialize(const variables_map& options) {
       else
          blocks_dir = bld;
 
+      if (options.count( "chain-id" ))
+         chain_id = fc::sha256( options.at( "chain-id" ).as<string>() );
+      EOS_ASSERT( threads > 0, fc::invalid_arg_exception, "--threads must be positive" );
+      EOS_ASSERT( producers > 0, fc::invalid_arg_exception, "--producers must be positive" );
+
+      if (options.count( "block-id" ))
+         block_id = block_id_type( options.at( "block-id" ).as<string>() );
+
       if (options.count( "output-file" )) {
          bld = options.at( "output-file" ).as<bfs::path>();
          if( bld.is_relative())
@@ -184,7 +505,16 @@ int main(int argc, char** argv)
          return 0;
       }
       blog.initialize(vmap);
-      blog.read_log();
+      if (blog.verify_only)
+         return blog.verify() ? 0 : 1;
+      else if (blog.compact_only)
+         blog.compact();
+      else if (!blog.merge_files.empty())
+         blog.merge_nodes();
+      else if (blog.latency)
+         blog.report_latency();
+      else
+         blog.read_log();
    } catch( const fc::exception& e ) {
       elog( "${e}", ("e", e.to_detail_string()));
       return -1;